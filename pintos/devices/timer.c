@@ -26,7 +26,13 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Threads blocked in timer_sleep(), in order of wake_tick, so
+   the timer interrupt only ever looks at the front.  Protected
+   by disabling interrupts. */
+static struct list sleep_list;
+
 static intr_handler_func timer_interrupt;
+static list_less_func wake_tick_less;
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
@@ -35,6 +41,7 @@ static void real_time_delay(int64_t num, int32_t denom);
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
 void timer_init(void) {
+    list_init(&sleep_list);
     pit_configure_channel(0, 2, TIMER_FREQ);
     intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
@@ -78,13 +85,24 @@ int64_t timer_elapsed(int64_t then) {
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The thread blocks on sleep_list until timer_interrupt() finds
+   that its wake tick has come, so it takes no CPU time while
+   asleep; if every thread is asleep, the idle thread halts. */
 void timer_sleep(int64_t ticks) {
-    int64_t start = timer_ticks();
+    struct thread *cur = thread_current();
+    enum intr_level old_level;
 
     ASSERT(intr_get_level() == INTR_ON);
-    while (timer_elapsed(start) < ticks)
-        thread_yield();
+    if (ticks <= 0)
+        return;
+
+    old_level = intr_disable();
+    cur->wake_tick = timer_ticks() + ticks;
+    list_insert_ordered(&sleep_list, &cur->elem, wake_tick_less, NULL);
+    thread_block();
+    intr_set_level(old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -143,12 +161,32 @@ void timer_print_stats(void) {
     printf("Timer: %" PRId64 " ticks\n", timer_ticks());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Wakes the sleeping threads whose
+   time has come, which are all at the front of sleep_list. */
 static void timer_interrupt(struct intr_frame *args UNUSED) {
     ticks++;
+    while (!list_empty(&sleep_list)) {
+        struct thread *t = list_entry(list_front(&sleep_list), struct thread, elem);
+        if (t->wake_tick > ticks)
+            break;
+        list_pop_front(&sleep_list);
+        thread_unblock(t);
+    }
     thread_tick();
 }
 
+/* Returns true if thread A should wake up before thread B.  Ties
+   keep the order the threads went to sleep in, since
+   list_insert_ordered() inserts before the first greater
+   element. */
+static bool wake_tick_less(const struct list_elem *a_, const struct list_elem *b_,
+                           void *aux UNUSED) {
+    const struct thread *a = list_entry(a_, struct thread, elem);
+    const struct thread *b = list_entry(b_, struct thread, elem);
+
+    return a->wake_tick < b->wake_tick;
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool too_many_loops(unsigned loops) {
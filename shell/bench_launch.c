@@ -0,0 +1,138 @@
+/* Launch-latency microbenchmark: how long it takes to start /bin/true and
+ * reap it through the shell's old fork path, vfork + execve, and the
+ * posix_spawn path the shell uses now. Each child gets the same setup as a
+ * shell command (its own process group, default signals).
+ *
+ * The cost of fork grows with the parent's address space, so the whole run is
+ * repeated with a ballast of touched heap standing in for a grown shell
+ * (history, caches, job tables).
+ *
+ * usage: bench_launch [ITERATIONS [BALLAST_MB...]] */
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static char *const child_argv[] = {"true", NULL};
+static const char *child_path = "/bin/true";
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//what the shell's child used to do between fork and exec
+static void child_setup(void) {
+    setpgid(0, 0);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+}
+
+static pid_t launch_fork(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        child_setup();
+        execv(child_path, child_argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launch_vfork(void) {
+    pid_t pid = vfork();
+    if (pid == 0) { //only async-signal-safe calls until exec
+        child_setup();
+        execve(child_path, child_argv, environ);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launch_spawn(void) {
+    posix_spawnattr_t attr;
+    sigset_t defaults, none;
+    pid_t pid;
+
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGQUIT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTIN);
+    sigaddset(&defaults, SIGTTOU);
+    sigaddset(&defaults, SIGTERM);
+    sigemptyset(&none);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF |
+                                        POSIX_SPAWN_SETSIGMASK);
+    if (posix_spawn(&pid, child_path, NULL, &attr, child_argv, environ) != 0) {
+        pid = -1;
+    }
+    posix_spawnattr_destroy(&attr);
+    return pid;
+}
+
+/* Average microseconds per launch + waitpid. */
+static double time_launches(pid_t launch(void), int iterations) {
+    double start = now();
+    for (int i = 0; i < iterations; i++) {
+        int status;
+        pid_t pid = launch();
+        if (pid < 0) {
+            perror("launch");
+            exit(1);
+        }
+        waitpid(pid, &status, 0);
+    }
+    return (now() - start) / iterations * 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = (argc > 1) ? atoi(argv[1]) : 2000;
+    static const char *const default_sizes[] = {"0", "64", "512"};
+    const char *const *sizes = (argc > 2) ? (const char *const *) argv + 2 : default_sizes;
+    int nsizes = (argc > 2) ? argc - 2 : 3;
+    char *ballast = NULL;
+    size_t ballast_len = 0;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [ITERATIONS [BALLAST_MB...]]\n", argv[0]);
+        return 1;
+    }
+    printf("%10s %14s %14s %14s\n", "ballast", "fork us", "vfork us", "spawn us");
+    for (int i = 0; i < nsizes; i++) {
+        size_t len = (size_t) atol(sizes[i]) << 20;
+        if (len > ballast_len) { //grow and touch every page, like a real heap
+            char *grown = realloc(ballast, len);
+            if (grown == NULL) {
+                perror("realloc");
+                return 1;
+            }
+            memset(grown + ballast_len, 1, len - ballast_len);
+            ballast = grown;
+            ballast_len = len;
+        }
+        printf("%7zu MB %14.1f %14.1f %14.1f\n", ballast_len >> 20,
+               time_launches(launch_fork, iterations),
+               time_launches(launch_vfork, iterations),
+               time_launches(launch_spawn, iterations));
+    }
+    free(ballast);
+    return 0;
+}
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+
+#include "jobs.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shell.h"
+#include "trace.h"
+
+//job control:
+    //every pipeline becomes a job = its process group + the pids in it
+    //SIGCHLD is blocked and read from a signalfd instead of a handler, so reaping
+    //happens where the shell chooses (before a prompt, or while it waits) and
+    //never in the middle of something else
+    //a signal just means "something changed": waitpid(-1, WNOHANG) finds out what
+    //foreground = the job owns the terminal until it exits or stops (ctrl-z)
+
+static struct job *job_list; //in order of id
+static struct job *current;  //what fg/bg/wait mean with no argument
+static int sigchld_fd = -1;
+
+void jobs_init(void) {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    //blocked signals still show up on the signalfd; children get an empty mask
+    //from posix_spawn, so they don't inherit this
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    sigchld_fd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd < 0) {
+        perror("signalfd");
+    }
+}
+
+int jobs_signal_fd(void) {
+    return sigchld_fd;
+}
+
+struct job *job_add(pid_t pgid, const pid_t *pids, size_t npids,
+                    const char *command, bool background) {
+    struct job *job = calloc(1, sizeof(struct job));
+    if (job == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    job->pids = malloc(npids * sizeof(pid_t));
+    job->statuses = calloc(npids, sizeof(int));
+    job->exited = calloc(npids, sizeof(bool));
+    job->command = strdup(command);
+    if (job->pids == NULL || job->statuses == NULL || job->exited == NULL ||
+        job->command == NULL) {
+        perror("malloc");
+        free(job->pids);
+        free(job->statuses);
+        free(job->exited);
+        free(job->command);
+        free(job);
+        return NULL;
+    }
+    //a stage that didn't start stays in the job as already exited with 127,
+    //like sh's "not found", so the status of the LAST stage is still its own
+    size_t started = 0;
+    for (size_t i = 0; i < npids; i++) {
+        job->pids[i] = (pids[i] > 0) ? pids[i] : 0;
+        job->exited[i] = pids[i] <= 0;
+        job->statuses[i] = (pids[i] > 0) ? 0 : W_EXITCODE(127, 0);
+        started += pids[i] > 0;
+    }
+    job->nprocs = npids;
+    if (started == 0) { //nothing started, nothing to wait for
+        free(job->pids);
+        free(job->statuses);
+        free(job->exited);
+        free(job->command);
+        free(job);
+        return NULL;
+    }
+    job->pgid = pgid;
+    job->state = JOB_RUNNING;
+    job->background = background;
+
+    //ids count up from the highest one in use, like bash
+    struct job **link = &job_list;
+    job->id = 1;
+    for (; *link != NULL; link = &(*link)->next) {
+        job->id = (*link)->id + 1;
+    }
+    *link = job;
+    if (background) {
+        current = job;
+    }
+    return job;
+}
+
+static void job_free(struct job *job) {
+    struct job **link = &job_list;
+    while (*link != job) {
+        link = &(*link)->next;
+    }
+    *link = job->next;
+    if (current == job) { //fall back to the newest job left
+        current = NULL;
+        for (struct job *j = job_list; j != NULL; j = j->next) {
+            current = j;
+        }
+    }
+    free(job->pids);
+    free(job->statuses);
+    free(job->exited);
+    free(job->command);
+    free(job);
+}
+
+/* Adds what one more process used to TOTAL. Times and counts add up; max RSS
+ * is the biggest single process, since they aren't all resident at once. */
+static void add_usage(struct rusage *total, const struct rusage *ru) {
+    timeradd(&total->ru_utime, &ru->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &ru->ru_stime, &total->ru_stime);
+    if (ru->ru_maxrss > total->ru_maxrss) {
+        total->ru_maxrss = ru->ru_maxrss;
+    }
+    total->ru_minflt += ru->ru_minflt;
+    total->ru_majflt += ru->ru_majflt;
+    total->ru_inblock += ru->ru_inblock;
+    total->ru_oublock += ru->ru_oublock;
+    total->ru_nvcsw += ru->ru_nvcsw;
+    total->ru_nivcsw += ru->ru_nivcsw;
+}
+
+/* Applies one wait4 result (and the usage of PID, if it ended) to whichever
+ * job owns PID. */
+static void update_job(pid_t pid, int status, const struct rusage *ru) {
+    for (struct job *job = job_list; job != NULL; job = job->next) {
+        for (size_t i = 0; i < job->nprocs; i++) {
+            if (job->pids[i] != pid) {
+                continue;
+            }
+            if (WIFSTOPPED(status)) {
+                job->state = JOB_STOPPED;
+            } else if (WIFCONTINUED(status)) {
+                job->state = JOB_RUNNING;
+            } else { //exited or killed
+                job->exited[i] = true;
+                job->statuses[i] = status;
+                add_usage(&job->usage, ru);
+                trace_reap(pid, status);
+                bool all = true;
+                for (size_t k = 0; k < job->nprocs; k++) {
+                    all = all && job->exited[k];
+                }
+                if (all) {
+                    job->state = JOB_DONE;
+                }
+            }
+            return;
+        }
+    }
+}
+
+void jobs_reap(void) {
+    struct signalfd_siginfo info;
+    //drain the fd first; signals merge, so the count means nothing
+    while (sigchld_fd >= 0 && read(sigchld_fd, &info, sizeof(info)) == sizeof(info)) {
+    }
+    int status;
+    pid_t pid;
+    struct rusage ru;
+    //wait4 = waitpid + what the child used, which `time` reports
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &ru)) > 0) {
+        update_job(pid, status, &ru);
+    }
+}
+
+void jobs_wait_change(void) {
+    if (sigchld_fd < 0) {
+        int status;
+        struct rusage ru;
+        pid_t pid = wait4(-1, &status, WUNTRACED, &ru);
+        if (pid > 0) {
+            update_job(pid, status, &ru);
+        }
+        return;
+    }
+    //a SIGCHLD that came after the last reap is still pending on the fd, so
+    //this can't sleep through a change
+    struct pollfd p = {.fd = sigchld_fd, .events = POLLIN};
+    if (poll(&p, 1, -1) < 0 && errno != EINTR) {
+        perror("poll");
+    }
+    jobs_reap();
+}
+
+/* Reaps until JOB is done (or stopped, if STOPPED_TOO), sleeping on the
+ * signalfd in between. */
+static void wait_until(struct job *job, bool stopped_too) {
+    for (;;) {
+        jobs_reap();
+        if (job->state == JOB_DONE || (stopped_too && job->state == JOB_STOPPED)) {
+            return;
+        }
+        struct pollfd p = {.fd = sigchld_fd, .events = POLLIN};
+        if (sigchld_fd < 0) {
+            //no signalfd: fall back to blocking on the job's processes directly
+            int status;
+            struct rusage ru;
+            pid_t pid = wait4(-job->pgid, &status, stopped_too ? WUNTRACED : 0, &ru);
+            if (pid > 0) {
+                update_job(pid, status, &ru);
+            } else if (errno == ECHILD) {
+                job->state = JOB_DONE;
+            }
+        } else if (poll(&p, 1, -1) < 0 && errno != EINTR) {
+            perror("poll");
+            return;
+        }
+    }
+}
+
+static int last_status(struct job *job) {
+    return job->statuses[job->nprocs - 1];
+}
+
+int job_foreground(struct job *job, bool cont, struct rusage *usage) {
+    job->background = false;
+    if (shell_is_interactive) {
+        tcsetpgrp(shell_terminal, job->pgid); //put the job in the foreground
+        if (cont && job->has_tmodes) {
+            tcsetattr(shell_terminal, TCSADRAIN, &job->tmodes);
+        }
+    }
+    if (cont) {
+        kill(-job->pgid, SIGCONT);
+        job->state = JOB_RUNNING;
+    }
+
+    wait_until(job, true);
+
+    if (shell_is_interactive) {
+        //now that the job is done (or stopped), the shell goes back in the foreground
+        tcsetpgrp(shell_terminal, shell_pgid);
+        job->has_tmodes = tcgetattr(shell_terminal, &job->tmodes) == 0;
+        tcsetattr(shell_terminal, TCSADRAIN, &shell_tmodes);
+    }
+    if (job->state == JOB_STOPPED) {
+        current = job;
+        job->background = true; //it's not in the foreground anymore
+        fprintf(stderr, "\n[%d]+  Stopped\t%s\n", job->id, job->command);
+        return W_STOPCODE(SIGTSTP);
+    }
+    int status = last_status(job);
+    if (usage != NULL) {
+        *usage = job->usage;
+    }
+    job_free(job);
+    return status;
+}
+
+void job_background(struct job *job, bool cont) {
+    job->background = true;
+    current = job;
+    if (cont) {
+        kill(-job->pgid, SIGCONT);
+        job->state = JOB_RUNNING;
+        printf("[%d]+ %s &\n", job->id, job->command);
+    }
+}
+
+int jobs_wait(struct job *job) {
+    int status = 0;
+    if (job != NULL) {
+        wait_until(job, true); //a stopped job would never finish on its own
+        if (job->state == JOB_STOPPED) {
+            return W_STOPCODE(SIGTSTP);
+        }
+        status = last_status(job);
+        job_free(job);
+        return status;
+    }
+    //no argument: every job that can still finish, oldest first
+    for (job = job_list; job != NULL;) {
+        struct job *next;
+        wait_until(job, true);
+        next = job->next;
+        if (job->state == JOB_DONE) {
+            status = last_status(job);
+            job_free(job);
+        }
+        job = next;
+    }
+    return status;
+}
+
+static const char *state_name(enum job_state state) {
+    switch (state) {
+    case JOB_RUNNING:
+        return "Running";
+    case JOB_STOPPED:
+        return "Stopped";
+    default:
+        return "Done";
+    }
+}
+
+void jobs_notify(FILE *out) {
+    struct job *job = job_list;
+    while (job != NULL) {
+        struct job *next = job->next;
+        if (job->state == JOB_DONE && job->background) {
+            fprintf(out, "[%d]%c  Done\t%s\n", job->id, job == current ? '+' : ' ',
+                    job->command);
+            job_free(job);
+        }
+        job = next;
+    }
+}
+
+void jobs_print(FILE *out) {
+    for (struct job *job = job_list; job != NULL; job = job->next) {
+        fprintf(out, "[%d]%c  %-8s\t%s%s\n", job->id, job == current ? '+' : ' ',
+                state_name(job->state), job->command,
+                job->state == JOB_RUNNING ? " &" : "");
+    }
+}
+
+struct job *job_find(const char *spec) {
+    if (spec == NULL) {
+        return current;
+    }
+    bool by_id = spec[0] == '%';
+    char *end;
+    long n = strtol(spec + by_id, &end, 10);
+    if (*end != '\0' || end == spec + by_id) {
+        return NULL;
+    }
+    for (struct job *job = job_list; job != NULL; job = job->next) {
+        if (job->id == n) {
+            return job;
+        }
+        for (size_t i = 0; !by_id && i < job->nprocs; i++) {
+            if (job->pids[i] > 0 && job->pids[i] == n) { //a bare number can also be a pid, like in `wait`
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,70 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <termios.h>
+
+enum job_state { JOB_RUNNING, JOB_STOPPED, JOB_DONE };
+
+/* A pipeline the shell started: one process group, one entry per stage. */
+struct job {
+    int id;              /* The n in %n. */
+    pid_t pgid;
+    size_t nprocs;
+    pid_t *pids;         /* 0 for a stage that didn't start (exited, 127). */
+    int *statuses;       /* Wait status of each process, once it has exited. */
+    bool *exited;
+    struct rusage usage; /* Summed over the processes that have exited. */
+    enum job_state state;
+    bool background;
+    char *command;       /* As typed, for `jobs`. */
+    struct termios tmodes; /* The job's terminal modes, saved when it stops. */
+    bool has_tmodes;
+    struct job *next;
+};
+
+/* Blocks SIGCHLD and opens the signalfd children are reaped through. */
+void jobs_init(void);
+
+/* The signalfd; readable when there may be children to reap. */
+int jobs_signal_fd(void);
+
+/* Records the NPIDS stages in PIDS as a new job in process group PGID. A pid
+ * <= 0 is a stage that didn't start, which counts as exited with status 127.
+ * Returns NULL if no stage started, so there is nothing to track. */
+struct job *job_add(pid_t pgid, const pid_t *pids, size_t npids,
+                    const char *command, bool background);
+
+/* Collects every child status change that is ready, without blocking. */
+void jobs_reap(void);
+
+/* Blocks until some child has changed state, then reaps like jobs_reap. */
+void jobs_wait_change(void);
+
+/* Gives JOB the terminal (sending SIGCONT first if CONT) and waits until it
+ * finishes or stops, then takes the terminal back. A finished job is removed
+ * from the table, after its resource usage is copied to USAGE (if not NULL).
+ * Returns the wait status of its last process, which is a stopped status if
+ * it stopped instead. */
+int job_foreground(struct job *job, bool cont, struct rusage *usage);
+
+/* Lets JOB run without the terminal, sending SIGCONT first if CONT. */
+void job_background(struct job *job, bool cont);
+
+/* Waits for JOB (or, if NULL, every background job) to finish, and removes
+ * it. Returns the wait status of its (the last job's) last process. */
+int jobs_wait(struct job *job);
+
+/* Prints "Done" for finished background jobs and removes them. */
+void jobs_notify(FILE *out);
+
+/* Prints the table like `jobs`. */
+void jobs_print(FILE *out);
+
+/* Finds "%n", "n" or a pid; NULL SPEC means the current (latest) job. */
+struct job *job_find(const char *spec);
+
+#endif
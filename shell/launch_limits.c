@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+
+#include "launch_limits.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//limit [--cpus 0-3,8] [-v KB] [-n FILES] [-u PROCS] command...
+//posix_spawn can't set a CPU set or rlimits, so a limited pipeline starts every
+//stage with fork: the child applies them to itself and then execs
+    //never set on the shell, even for a moment: with a low -u or -v the
+    //shell's own spawn, pipes and mallocs would run under them and fail
+    //no window where the command runs without them either
+    //only SOFT limits are touched, so the command can still raise them back
+
+/* Parses a taskset-style list like "0-3,8" into SET. */
+static int parse_cpus(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    for (const char *p = list;;) {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end != p && *end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+        }
+        if (end == p || lo < 0 || hi < lo || hi >= CPU_SETSIZE) {
+            break;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == '\0') {
+            return 0;
+        } else if (*end != ',') {
+            break;
+        }
+        p = end + 1;
+    }
+    fprintf(stderr, "limit: --cpus: bad CPU list '%s'\n", list);
+    return -1;
+}
+
+/* Parses a limit value: a number (times SCALE) or "unlimited". */
+static int parse_value(const char *option, const char *s, rlim_t scale, rlim_t *value) {
+    if (strcmp(s, "unlimited") == 0) {
+        *value = RLIM_INFINITY;
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (*s == '\0' || *s == '-' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "limit: %s: bad value '%s'\n", option, s);
+        return -1;
+    }
+    *value = (rlim_t) n * scale;
+    return 0;
+}
+
+int limits_parse(struct tokens *tokens, size_t *first, struct launch_limits *limits) {
+    memset(limits, 0, sizeof(*limits));
+    size_t i = *first + 1; //past "limit"
+    size_t length = tokens_get_length(tokens);
+    for (; i + 1 < length; i += 2) {
+        const char *option = tokens_get_token(tokens, i);
+        const char *arg = tokens_get_token(tokens, i + 1);
+        int resource;
+        rlim_t scale = 1;
+        if (strcmp(option, "--cpus") == 0) {
+            if (parse_cpus(arg, &limits->cpus) != 0) {
+                return -1;
+            }
+            limits->has_cpus = true;
+            continue;
+        } else if (strcmp(option, "-v") == 0) {
+            resource = RLIMIT_AS;
+            scale = 1024; //KB, like ulimit -v
+        } else if (strcmp(option, "-n") == 0) {
+            resource = RLIMIT_NOFILE;
+        } else if (strcmp(option, "-u") == 0) {
+            resource = RLIMIT_NPROC;
+        } else {
+            break; //the command starts here
+        }
+        size_t k = 0;
+        while (k < limits->nlimits && limits->limits[k].resource != resource) {
+            k++; //given twice: the last one wins
+        }
+        if (parse_value(option, arg, scale, &limits->limits[k].value) != 0) {
+            return -1;
+        }
+        limits->limits[k].resource = resource;
+        limits->nlimits += (k == limits->nlimits);
+    }
+    if (i >= length) {
+        fprintf(stderr, "limit: usage: limit [--cpus LIST] [-v KB] [-n N] [-u N] command\n");
+        return -1;
+    }
+    *first = i;
+    return 0;
+}
+
+bool limits_any(const struct launch_limits *limits) {
+    return limits->has_cpus || limits->nlimits > 0;
+}
+
+int limits_apply(const struct launch_limits *limits) {
+    if (limits->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &limits->cpus) != 0) {
+        perror("limit: --cpus");
+        return -1;
+    }
+    for (size_t k = 0; k < limits->nlimits; k++) {
+        struct rlimit rl;
+        int resource = limits->limits[k].resource;
+        if (getrlimit(resource, &rl) != 0) {
+            perror("limit: getrlimit");
+            return -1;
+        }
+        rl.rlim_cur = limits->limits[k].value;
+        if (setrlimit(resource, &rl) != 0) { //above the hard limit
+            perror("limit: setrlimit");
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef LAUNCH_LIMITS_H_
+#define LAUNCH_LIMITS_H_
+
+#include <sched.h> /* cpu_set_t needs _GNU_SOURCE */
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/resource.h>
+
+#include "tokenizer.h"
+
+/* What `limit` asks for: CPUs to run on and soft resource limits. */
+struct launch_limits {
+    bool has_cpus;
+    cpu_set_t cpus;
+    size_t nlimits;
+    struct {
+        int resource;   /* RLIMIT_AS, RLIMIT_NOFILE or RLIMIT_NPROC. */
+        rlim_t value;   /* Soft limit, in the resource's own units. */
+    } limits[3];
+};
+
+/* Parses "limit [--cpus LIST] [-v KB] [-n N] [-u N]" starting at token
+ * *FIRST, which is left pointing at the command. Returns 0, or -1 after
+ * printing an error. */
+int limits_parse(struct tokens *tokens, size_t *first, struct launch_limits *limits);
+
+/* Whether LIMITS asks for anything at all. */
+bool limits_any(const struct launch_limits *limits);
+
+/* Applies LIMITS to the calling process: a child of the shell, between fork
+ * and exec, so the shell's own limits never change. Returns 0, or -1 after
+ * printing an error. */
+int limits_apply(const struct launch_limits *limits);
+
+#endif
@@ -0,0 +1,134 @@
+#include "path_hash.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//like `hash` in sh: remember name -> /full/path so a command we've run before
+//goes straight to one execv instead of trying every PATH directory
+//a remembered path is only trusted while:
+    //PATH is the same string it was looked up under (otherwise forget everything)
+    //the file is still there and executable (otherwise forget just that one)
+
+#define NBUCKETS 64
+
+struct entry {
+    char *name;
+    char *path;
+    unsigned hits;
+    struct entry *next;
+};
+
+static struct entry *buckets[NBUCKETS];
+static char *cached_for; //the PATH the entries were found under
+
+static unsigned hash_name(const char *name) {
+    unsigned h = 5381; //djb2
+    while (*name != '\0') {
+        h = h * 33 + (unsigned char) *name++;
+    }
+    return h % NBUCKETS;
+}
+
+static bool is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+void path_forget_all(void) {
+    for (int b = 0; b < NBUCKETS; b++) {
+        while (buckets[b] != NULL) {
+            struct entry *e = buckets[b];
+            buckets[b] = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+        }
+    }
+    free(cached_for);
+    cached_for = NULL;
+}
+
+/* Searches every directory of PATH for NAME. Returns a malloc'd path or NULL. */
+static char *search_path(const char *path, const char *name) {
+    size_t name_len = strlen(name);
+    while (*path != '\0') {
+        size_t dir_len = strcspn(path, ":");
+        if (dir_len > 0) { //empty entries are skipped, as before
+            char *full = malloc(dir_len + name_len + 2);
+            if (full == NULL) {
+                return NULL;
+            }
+            memcpy(full, path, dir_len);
+            full[dir_len] = '/';
+            memcpy(full + dir_len + 1, name, name_len + 1);
+            if (is_executable(full)) {
+                return full;
+            }
+            free(full);
+        }
+        path += dir_len + (path[dir_len] == ':');
+    }
+    return NULL;
+}
+
+const char *path_lookup(const char *name) {
+    const char *path = getenv("PATH");
+    if (path == NULL) {
+        return NULL;
+    }
+    if (cached_for == NULL || strcmp(cached_for, path) != 0) {
+        path_forget_all(); //PATH changed, every answer may be wrong now
+        if ((cached_for = strdup(path)) == NULL) {
+            return NULL;
+        }
+    }
+
+    struct entry **link = &buckets[hash_name(name)];
+    for (; *link != NULL; link = &(*link)->next) {
+        struct entry *e = *link;
+        if (strcmp(e->name, name) != 0) {
+            continue;
+        }
+        if (is_executable(e->path)) {
+            e->hits++;
+            return e->path;
+        }
+        *link = e->next; //it went away; drop it and search again
+        free(e->name);
+        free(e->path);
+        free(e);
+        break;
+    }
+
+    char *full = search_path(path, name);
+    struct entry *e = (full != NULL) ? malloc(sizeof(struct entry)) : NULL;
+    if (e == NULL || (e->name = strdup(name)) == NULL) {
+        free(full);
+        free(e);
+        return NULL;
+    }
+    e->path = full;
+    e->hits = 1;
+    e->next = buckets[hash_name(name)];
+    buckets[hash_name(name)] = e;
+    return full;
+}
+
+void path_print(FILE *out) {
+    bool any = false;
+    for (int b = 0; b < NBUCKETS; b++) {
+        for (struct entry *e = buckets[b]; e != NULL; e = e->next) {
+            if (!any) {
+                fprintf(out, "hits\tcommand\n");
+                any = true;
+            }
+            fprintf(out, "%4u\t%s\n", e->hits, e->path);
+        }
+    }
+    if (!any) {
+        fprintf(out, "hash: hash table empty\n");
+    }
+}
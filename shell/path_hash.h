@@ -0,0 +1,17 @@
+#ifndef PATH_HASH_H_
+#define PATH_HASH_H_
+
+#include <stdio.h>
+
+/* Where NAME (a command without a '/') lives on PATH, or NULL if nowhere.
+ * Answers are remembered until PATH changes or the file goes away. The
+ * string belongs to the cache; copy it to keep it. */
+const char *path_lookup(const char *name);
+
+/* Forget every remembered command. */
+void path_forget_all(void);
+
+/* Print the remembered commands and how often each was looked up. */
+void path_print(FILE *out);
+
+#endif
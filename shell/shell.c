@@ -1,17 +1,32 @@
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "jobs.h"
+#include "launch_limits.h"
+#include "path_hash.h"
+#include "shell.h"
 #include "tokenizer.h"
+#include "trace.h"
+#include "utils.h"
 
 /* Convenience macro to silence compiler warnings about unused function
  * parameters. */
@@ -29,11 +44,23 @@ struct termios shell_tmodes;
 /* Process group id for the shell */
 pid_t shell_pgid;
 
+extern char **environ;
+
 int cmd_exit(struct tokens *tokens);
 int cmd_help(struct tokens *tokens);
 //new
 int cmd_pwd(struct tokens *tokens);
 int cmd_cd(struct tokens *tokens);
+int cmd_hash(struct tokens *tokens);
+int cmd_jobs(struct tokens *tokens);
+int cmd_fg(struct tokens *tokens);
+int cmd_bg(struct tokens *tokens);
+int cmd_wait(struct tokens *tokens);
+int cmd_time(struct tokens *tokens);
+int cmd_parallel(struct tokens *tokens);
+int cmd_limit(struct tokens *tokens);
+
+static int run_pipeline(struct tokens *tokens, size_t first, struct rusage *usage);
 
 /* Built-in command functions take token array (see parse.h) and return int */
 typedef int cmd_fun_t(struct tokens *tokens);
@@ -43,6 +70,14 @@ typedef struct fun_desc {
     cmd_fun_t *fun;
     char *cmd;
     char *doc;
+    bool whole_line; //does its own | and & (it runs pipelines itself)
+    //at the prompt: the shell ignores ctrl-c and ctrl-z, which only reach the
+    //job that has the terminal, so a built-in that can run for a long time
+    //runs as a job instead (a fork, like a built-in in a pipeline)
+        //READS_ARGS: reads its operands (or stdin without any, or for "-")
+        //READS_STDIN: reads stdin, writes its operands
+        //both stay in the shell when all of that is regular files, which end
+    enum { IN_SHELL, AS_JOB, READS_ARGS, READS_STDIN } interactive;
 } fun_desc_t;
 
 fun_desc_t cmd_table[] = {
@@ -51,6 +86,22 @@ fun_desc_t cmd_table[] = {
     //me
     {cmd_pwd, "pwd", "print the current working directory"},
     {cmd_cd, "cd", "change the current working directory"},
+    {cmd_hash, "hash", "list remembered command paths (-r forgets them)"},
+    {cmd_jobs, "jobs", "list background and stopped jobs"},
+    {cmd_fg, "fg", "move a job (default: the current one) to the foreground"},
+    {cmd_bg, "bg", "resume a stopped job in the background"},
+    {cmd_wait, "wait", "wait for a job, or for every background job"},
+    {cmd_parallel, "parallel", "run a command for every argument (after :::, or stdin lines), -j N at a time; {} is the argument", false, AS_JOB},
+    {cmd_limit, "limit", "run a pipeline on some CPUs (--cpus 0-3) and/or with lower limits (-v KB of memory, -n open files, -u processes)", true},
+    {cmd_time, "time", "run a pipeline and report its time and resource usage (-m: one key=value line, -o FILE: append it there)", true},
+    //utilities that scripts call in loops: no fork + exec when run on their own
+    {cmd_echo, "echo", "print the arguments (-n: no newline)"},
+    {cmd_cat, "cat", "copy files (or stdin) to stdout", false, READS_ARGS},
+    {cmd_test, "test", "check a file or compare strings/numbers"},
+    {cmd_test, "[", "same as test, ending in ]"},
+    {cmd_true, "true", "do nothing, successfully"},
+    {cmd_false, "false", "do nothing, unsuccessfully"},
+    {cmd_tee, "tee", "copy stdin to stdout and files (-a appends), with splice when it can", false, READS_STDIN},
 };
 
 /* Prints a helpful description for the given command */
@@ -98,6 +149,150 @@ int cmd_cd(struct tokens *tokens) {
     return 1;
 }
 
+//show (or with -r, throw away) the PATH cache
+int cmd_hash(struct tokens *tokens) {
+    char *arg = tokens_get_token(tokens, 1);
+    if (arg == NULL) {
+        path_print(stdout);
+    } else if (strcmp(arg, "-r") == 0) {
+        path_forget_all();
+    } else {
+        fprintf(stderr, "hash: usage: hash [-r]\n");
+        return -1;
+    }
+    return 1;
+}
+
+int cmd_jobs(unused struct tokens *tokens) {
+    jobs_reap(); //so the states shown are up to date
+    jobs_print(stdout);
+    return 1;
+}
+
+//fg/bg/wait all take an optional %n (or pid); no argument = the current job
+static struct job *job_arg(const char *cmd, struct tokens *tokens) {
+    char *spec = tokens_get_token(tokens, 1);
+    struct job *job = job_find(spec);
+    if (job == NULL) {
+        fprintf(stderr, "%s: %s: no such job\n", cmd, spec != NULL ? spec : "current");
+    }
+    return job;
+}
+
+int cmd_fg(struct tokens *tokens) {
+    struct job *job = job_arg("fg", tokens);
+    if (job == NULL) {
+        return -1;
+    }
+    printf("%s\n", job->command);
+    fflush(stdout);
+    job_foreground(job, true, NULL);
+    return 1;
+}
+
+int cmd_bg(struct tokens *tokens) {
+    struct job *job = job_arg("bg", tokens);
+    if (job == NULL) {
+        return -1;
+    }
+    job_background(job, true);
+    return 1;
+}
+
+int cmd_wait(struct tokens *tokens) {
+    struct job *job = NULL;
+    if (tokens_get_length(tokens) > 1 && (job = job_arg("wait", tokens)) == NULL) {
+        return -1;
+    }
+    jobs_wait(job);
+    return 1;
+}
+
+static double seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Seconds of wall clock since START. */
+static double since(struct timespec start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+//time [-m] [-o FILE] pipeline
+    //wall clock = around the whole launch + wait, from the shell's side
+    //everything else = the wait4 rusage of every process in the job, added up
+    //(max RSS is the biggest single process)
+    //-m prints one key=value line for scripts instead of the table
+int cmd_time(struct tokens *tokens) {
+    bool machine = false;
+    const char *file = NULL;
+    size_t first = 1;
+    size_t length = tokens_get_length(tokens);
+    for (; first < length; first++) {
+        char *arg = tokens_get_token(tokens, first);
+        if (strcmp(arg, "-m") == 0) {
+            machine = true;
+        } else if (strcmp(arg, "-o") == 0 && first + 1 < length) {
+            file = tokens_get_token(tokens, ++first);
+            machine = true;
+        } else {
+            break;
+        }
+    }
+    if (first == length) {
+        fprintf(stderr, "time: usage: time [-m] [-o FILE] command [| command...]\n");
+        return -1;
+    }
+    if (strcmp(tokens_get_token(tokens, length - 1), "&") == 0) {
+        fprintf(stderr, "time: can't time a background job\n");
+        return -1;
+    }
+
+    struct timespec start;
+    struct rusage ru;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = run_pipeline(tokens, first, &ru);
+    double real = since(start);
+    if (status == -1 || WIFSTOPPED(status)) {
+        return -1; //nothing ran, or it's not finished; there's nothing to report
+    }
+
+    FILE *out = stderr; //like bash, so the command's own output stays clean
+    if (file != NULL && (out = fopen(file, "a")) == NULL) {
+        perror(file);
+        return -1;
+    }
+    if (machine) {
+        fprintf(out,
+                "real=%.6f user=%.6f sys=%.6f maxrss_kb=%ld minflt=%ld majflt=%ld "
+                "inblock=%ld oublock=%ld nvcsw=%ld nivcsw=%ld status=%d\n",
+                real, seconds(ru.ru_utime), seconds(ru.ru_stime), ru.ru_maxrss,
+                ru.ru_minflt, ru.ru_majflt, ru.ru_inblock, ru.ru_oublock, ru.ru_nvcsw,
+                ru.ru_nivcsw,
+                WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    } else {
+        fprintf(out, "\nreal\t%.3fs\nuser\t%.3fs\nsys\t%.3fs\n", real,
+                seconds(ru.ru_utime), seconds(ru.ru_stime));
+        fprintf(out, "maxrss\t%ld KB\n", ru.ru_maxrss);
+        fprintf(out, "faults\t%ld major, %ld minor\n", ru.ru_majflt, ru.ru_minflt);
+        fprintf(out, "ctxsw\t%ld voluntary, %ld involuntary\n", ru.ru_nvcsw,
+                ru.ru_nivcsw);
+        fprintf(out, "blockio\t%ld in, %ld out\n", ru.ru_inblock, ru.ru_oublock);
+    }
+    if (out != stderr) {
+        fclose(out);
+    }
+    return 1;
+}
+
+//limit [--cpus LIST] [-v KB] [-n N] [-u N] pipeline: run_pipeline does the work,
+//so `time limit ...` and `limit ... &` work too
+int cmd_limit(struct tokens *tokens) {
+    int status = run_pipeline(tokens, 0, NULL);
+    return (status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 1 : -1;
+}
+
 /* Looks up the built-in command, if it exists. */
 int lookup(char *cmd) {
     if (cmd != NULL) {
@@ -110,6 +305,12 @@ int lookup(char *cmd) {
     return -1;
 }
 
+/* The exit status for what a built-in returned: 1 = success (0), a syntax
+ * error (2), anything else = failure (1). */
+static int builtin_status(int rc) {
+    return (rc == 1) ? 0 : (rc == BUILTIN_SYNTAX_ERROR) ? 2 : 1;
+}
+
 /* Intialization procedures for this shell */
 void init_shell() {
     /* Our shell is connected to standard input. */
@@ -145,149 +346,986 @@ void init_shell() {
         signal(SIGTTOU, SIG_IGN);
         signal(SIGTERM, SIG_IGN);
     }
+
+    jobs_init();
 }
 
-int main(unused int argc, unused char *argv[]) {
-    init_shell();
+//pipelines: "a args < in | b args | c args > out"
+//plan:
+    //split the tokens at every "|" into stages (each stage = argv + its own < / > files)
+    //make nstages-1 pipes; stage i reads pipe i-1 and writes pipe i
+    //start every stage before waiting on any of them, so they all run at once
+    //all stages go in ONE process group (the first child's pid), so ctrl-c etc
+    //hit the whole pipeline and the terminal can be handed to it as a unit
+    //then wait for every stage and take the terminal back
 
-    static char line[4096];
-    int line_num = 0;
+/* One stage of a pipeline. */
+struct stage {
+    char **argv;  //NULL-terminated; points into the tokens, not copies (all the
+                  //stages share stages[0].argv's array)
+    size_t argc;
+    char *input;  //file after <, or NULL
+    char *output; //file after >, or NULL
+    char *path;   //what argv[0] resolved to (malloc'd), or NULL if not found
+    double lookup; //microseconds it took to find path (only with SHELL_TRACE)
+};
 
-    /* Only print shell prompts when standard input is not a tty */
-    if (shell_is_interactive) {
-        fprintf(stdout, "%d: ", line_num);
+/* Frees what parse_pipeline returned. */
+static void free_pipeline(struct stage *stages, size_t nstages) {
+    for (size_t i = 0; i < nstages; i++) {
+        free(stages[i].path);
+    }
+    free(stages[0].argv);
+    free(stages);
+}
+
+/* Splits TOKENS FIRST..LENGTH-1 at every "|" into stages, pulling out < and >
+ * redirections. Returns NULL and prints an error if a stage is empty or a
+ * redirection has no file name. */
+static struct stage *parse_pipeline(struct tokens *tokens, size_t first, size_t length,
+                                    size_t *nstages) {
+    size_t count = 1;
+    for (size_t i = first; i < length; i++) { //count the |'s first
+        count += strcmp(tokens_get_token(tokens, i), "|") == 0;
     }
 
-    while (fgets(line, 4096, stdin)) {
-        /* Split our line into words. */
-        struct tokens *tokens = tokenize(line);
+    struct stage *stages = calloc(count, sizeof(struct stage));
+    if (stages == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    size_t s = 0;
+    //one array for every stage's words and NULLs, so a long line costs one malloc
+    stages[0].argv = malloc((length - first + count) * sizeof(char *));
+    if (stages[0].argv == NULL) {
+        perror("malloc");
+        free(stages);
+        return NULL;
+    }
+    for (size_t i = first; i < length; i++) {
+        char *token = tokens_get_token(tokens, i);
+        struct stage *st = &stages[s];
+        if (strcmp(token, "|") == 0) {
+            if (st->argc == 0) {
+                break; //nothing before this |
+            }
+            st->argv[st->argc] = NULL;
+            stages[++s].argv = st->argv + st->argc + 1;
+        } else if (strcmp(token, "<") == 0 || strcmp(token, ">") == 0) {
+            char *file = tokens_get_token(tokens, ++i);
+            if (file == NULL || strcmp(file, "|") == 0) {
+                fprintf(stderr, "syntax error: %s needs a file name\n", token);
+                free_pipeline(stages, s + 1);
+                return NULL;
+            }
+            if (token[0] == '<') {
+                st->input = file;
+            } else {
+                st->output = file;
+            }
+        } else {
+            st->argv[st->argc++] = token;
+        }
+    }
+    stages[s].argv[stages[s].argc] = NULL;
+    if (s + 1 != count || stages[s].argc == 0) {
+        fprintf(stderr, "syntax error: empty command in pipeline\n");
+        free_pipeline(stages, s + 1);
+        return NULL;
+    }
+    *nstages = count;
+    return stages;
+}
+
+/* Works out which file ARGV0 runs: itself if it has a '/', otherwise its
+ * PATH entry (through the cache, so this is done in the shell, not the
+ * child, where the answer would be lost). Returns a malloc'd path or NULL. */
+static char *resolve_program(const char *argv0) {
+    if (strchr(argv0, '/') != NULL) { //strchr gets first instance of / in args[0]
+        return strdup(argv0); //the path is given, run it as is
+    }
+    const char *path = path_lookup(argv0);
+    return (path != NULL) ? strdup(path) : NULL;
+}
+
+/* Fills in ST's path (and, when tracing, how long that took). */
+static void resolve_stage(struct stage *st) {
+    double start = trace_enabled() ? trace_now() : 0;
+    st->path = resolve_program(st->argv[0]);
+    if (trace_enabled()) {
+        double end = trace_now();
+        st->lookup = end - start;
+        trace_span("lookup", st->argv[0], start, end);
+    }
+}
+
+/* Starts one stage with posix_spawn: in process group PGID (0 = a new one
+ * led by this stage, which takes the terminal if FOREGROUND), with IN, OUT
+ * and ERR (-1 = leave alone) as its stdin, stdout and stderr and its own < / >
+ * applied on top. Returns its pid, or -1. */
+static pid_t spawn_stage(struct stage *st, pid_t pgid, bool foreground, int in,
+                         int out, int err, int pipes[][2], size_t npipes) {
+    //no fork of the shell's memory: glibc's posix_spawn uses a vfork-style clone,
+    //so everything the child does before exec is described up front instead
+    if (st->path == NULL) {
+        fprintf(stderr, "%s: command not found\n", st->argv[0]);
+        return -1;
+    }
+
+    //file actions run in the child in order, just like the old dup2/close/open calls
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (in >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    }
+    if (out >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    }
+    if (err >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, err, STDERR_FILENO);
+    }
+    //every pipe end has been copied where it's needed; close all the originals
+    //or the readers never see EOF
+    for (size_t i = 0; i < npipes; i++) {
+        posix_spawn_file_actions_addclose(&actions, pipes[i][0]);
+        posix_spawn_file_actions_addclose(&actions, pipes[i][1]);
+    }
+    //< and > win over the pipe (just like bash)
+    if (st->input != NULL) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, st->input,
+                                         O_RDONLY, 0);
+    }
+    if (st->output != NULL) { //write, create, erase, permissions
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, st->output,
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+    //the group leader takes the terminal itself, before it can read from it
+    if (shell_is_interactive && foreground && pgid == 0) {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, shell_terminal);
+    }
+#endif
+
+    //attributes: the process group, and the signals the shell ignores go back to
+    //default (handled signals reset on exec anyway, ignored ones don't)
+    posix_spawnattr_t attr;
+    sigset_t defaults, none;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGQUIT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTIN);
+    sigaddset(&defaults, SIGTTOU);
+    sigaddset(&defaults, SIGTERM);
+    sigemptyset(&none);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF |
+                                        POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid;
+    double start = trace_enabled() ? trace_now() : 0;
+    int rc = posix_spawn(&pid, st->path, &actions, &attr, st->argv, environ);
+    if (rc == 0 && trace_enabled()) { //it returns once the exec has happened
+        trace_spawn(pid, st->argv[0], st->lookup, start, trace_now());
+    }
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) { //exec (or a redirection) failed; exactly one execve was tried
+        //spawn can't say which action failed; name the < file if it's the culprit
+        const char *what = (st->input != NULL && access(st->input, R_OK) != 0)
+                               ? st->input
+                               : st->argv[0];
+        fprintf(stderr, "%s: %s\n", what, strerror(rc));
+        return -1;
+    }
+    return pid;
+}
+
+//a built-in in a pipeline (or with &) is its own stage: a fork of the shell
+//that runs it and exits, with no exec (and no program to find)
+    //only that stage forks; the other stages are spawned as usual
+    //whatever it changes (cd, hash -r) dies with the fork, like a subshell
+//a stage under `limit` forks too, program or not: the child sets its own CPU
+//set and rlimits right before the exec, which posix_spawn has no way to do
+
+/* Starts ST as a forked copy of the shell, set up like spawn_stage does, that
+ * runs built-in FUNDEX, or execs ST's program if FUNDEX is -1. LIMITS (or
+ * NULL) are applied in the child first. Returns its pid, or -1. */
+static pid_t fork_stage(struct stage *st, int fundex, const struct launch_limits *limits,
+                        pid_t pgid, bool foreground, int in, int out, int pipes[][2],
+                        size_t npipes) {
+    if (fundex < 0 && st->path == NULL) {
+        fprintf(stderr, "%s: command not found\n", st->argv[0]);
+        return -1;
+    }
+    double start = trace_enabled() ? trace_now() : 0;
+    trace_flush(); //or the child's exit could write the same events again
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid > 0) {
+        setpgid(pid, pgid == 0 ? pid : pgid); //also here, so it's done before any wait
+        if (fundex < 0 && trace_enabled()) { //the fork only, the exec is the child's
+            trace_spawn(pid, st->argv[0], st->lookup, start, trace_now());
+        }
+        return pid;
+    }
+
+    setpgid(0, pgid);
+    if (shell_is_interactive && foreground && pgid == 0) {
+        tcsetpgrp(shell_terminal, getpid());
+    }
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL); //the shell blocks SIGCHLD
+
+    if (in >= 0) {
+        dup2(in, STDIN_FILENO);
+    }
+    if (out >= 0) {
+        dup2(out, STDOUT_FILENO);
+    }
+    for (size_t i = 0; i < npipes; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    //same < / > rules as spawned stages
+    int fd;
+    if (st->input != NULL) {
+        if ((fd = open(st->input, O_RDONLY)) < 0 || dup2(fd, STDIN_FILENO) < 0) {
+            perror(st->input);
+            _exit(1);
+        }
+        close(fd);
+    }
+    if (st->output != NULL) {
+        if ((fd = open(st->output, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0 ||
+            dup2(fd, STDOUT_FILENO) < 0) {
+            perror(st->output);
+            _exit(1);
+        }
+        close(fd);
+    }
+    //whatever the shell read ahead into stdin's buffer (the rest of a script)
+    //is the shell's, not input for this stage
+    __fpurge(stdin);
+    if (limits != NULL && limits_apply(limits) != 0) {
+        _exit(126);
+    }
+    if (fundex < 0) {
+        execv(st->path, st->argv);
+        perror(st->argv[0]);
+        _exit(errno == ENOENT ? 127 : 126);
+    }
+    struct tokens *args = tokens_from_words(st->argv, st->argc);
+    int rc = (args != NULL) ? cmd_table[fundex].fun(args) : -1;
+    fflush(stdout); //only what the built-in wrote; the trace file is the shell's
+    fflush(stderr);
+    _exit(builtin_status(rc)); //not exit(): the shell's atexit handlers aren't ours
+}
+
+/* Starts ST one way or the other: a built-in or a stage under LIMITS (or
+ * NULL) in a fork, anything else with posix_spawn. */
+static pid_t start_stage(struct stage *st, const struct launch_limits *limits, pid_t pgid,
+                         bool foreground, int in, int out, int pipes[][2], size_t npipes) {
+    int fundex = lookup(st->argv[0]);
+    if (fundex >= 0 || limits != NULL) {
+        return fork_stage(st, fundex, limits, pgid, foreground, in, out, pipes, npipes);
+    }
+    return spawn_stage(st, pgid, foreground, in, out, -1, pipes, npipes);
+}
+
+/* Runs the pipeline in TOKENS (from token FIRST on) as a job. With a trailing
+ * "&" it's left running in the background; otherwise it gets the terminal and
+ * the shell waits for all of it (or for it to stop), copying what it used to
+ * USAGE if that isn't NULL. A leading "limit ..." applies to every stage.
+ * Returns the wait status of the last stage, 0 for a job left in the
+ * background, or -1 if nothing started. */
+static int run_pipeline(struct tokens *tokens, size_t first, struct rusage *usage) {
+    size_t length = tokens_get_length(tokens);
+    size_t start = first; //for the command text, which keeps the limit part
+    struct launch_limits limits = {0};
+    if (strcmp(tokens_get_token(tokens, first), "limit") == 0 &&
+        limits_parse(tokens, &first, &limits) != 0) {
+        return -1;
+    }
+    bool background = strcmp(tokens_get_token(tokens, length - 1), "&") == 0;
+    if (background && --length == first) {
+        fprintf(stderr, "syntax error: & needs a command\n");
+        return -1;
+    }
+    size_t nstages;
+    struct stage *stages = parse_pipeline(tokens, first, length, &nstages);
+    if (stages == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < nstages; i++) {
+        if (lookup(stages[i].argv[0]) < 0) { //built-ins don't need a path
+            resolve_stage(&stages[i]);
+        }
+    }
+
+    int pipes[nstages - 1][2];
+    size_t npipes = 0;
+    for (; npipes < nstages - 1; npipes++) {
+        if (pipe(pipes[npipes]) != 0) {
+            perror("pipe");
+            break;
+        }
+    }
+
+    fflush(stdout); //or the children inherit (and may print) whatever built-ins left buffered
+
+    const struct launch_limits *limited = limits_any(&limits) ? &limits : NULL;
+    pid_t pids[nstages];
+    pid_t pgid = 0; //set to the first child's pid once it exists
+    for (size_t i = 0; i < nstages; i++) {
+        int in = (i > 0) ? pipes[i - 1][0] : -1;
+        int out = (i < npipes) ? pipes[i][1] : -1;
+        //a stage that can't start is just missing; its neighbours see EOF/EPIPE
+        pids[i] = (npipes == nstages - 1) ? start_stage(&stages[i], limited, pgid, !background,
+                                                        in, out, pipes, npipes)
+                                          : -1;
+        if (pids[i] > 0 && pgid == 0) {
+            pgid = pids[i];
+        }
+    }
+    //the shell has no use for the pipes; closing them lets EOF through
+    for (size_t i = 0; i < npipes; i++) {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+
+    //the command text for `jobs`: the words without the &
+    size_t n = 1;
+    for (size_t i = start; i < length; i++) {
+        n += strlen(tokens_get_token(tokens, i)) + 1;
+    }
+    char *command = malloc(n);
+    char *end = command;
+    for (size_t i = start; command != NULL && i < length; i++) {
+        size_t len = strlen(tokens_get_token(tokens, i));
+        memcpy(end, tokens_get_token(tokens, i), len);
+        end += len;
+        *end++ = ' ';
+    }
+    if (command != NULL) {
+        end[-1] = '\0';
+    }
+
+    int status = -1;
+    struct job *job = job_add(pgid, pids, nstages, command != NULL ? command : "", background);
+    if (job != NULL && background) {
+        printf("[%d] %d\n", job->id, job->pgid);
+        status = 0;
+    } else if (job != NULL) {
+        double start = trace_enabled() ? trace_now() : 0;
+        status = job_foreground(job, false, usage); //waits for EVERY stage (or ctrl-z)
+        if (trace_enabled()) {
+            trace_span("wait", command != NULL ? command : "", start, trace_now());
+        }
+    }
+    free(command);
+    free_pipeline(stages, nstages);
+    return status;
+}
+
+//parallel [-j N] command args... [::: arg...]
+    //one run of the command per argument (the words after :::, or else the
+    //lines of stdin), with every {} replaced by it (or it's added at the end)
+    //at most N running at once; a new one starts as soon as ANY finishes
+    //each child's stdout+stderr go to its own memfd, copied out in one piece
+    //when it ends, so outputs never interleave (they come in finishing order)
+    //each child is a job in the job table, so the normal reaping sees it
+    //every child joins parallel's own process group: at the prompt parallel is
+    //a job (a fork) with the terminal, so ctrl-c and ctrl-z hit it and all its
+    //children at once, and fg/bg/jobs treat the lot as one job
+
+/* One running child of parallel. */
+struct parallel_slot {
+    struct job *job; //NULL = free slot
+    int out;         //memfd holding its output
+    struct timespec start;
+    char *command;
+};
 
-        /* Find which built-in function to run. */
-        int fundex = lookup(tokens_get_token(tokens, 0));
+/* The next argument for parallel: a token after :::, or a line of stdin.
+ * Returns a pointer that stays valid until the next call, or NULL at the end. */
+static char *parallel_next_arg(struct tokens *tokens, size_t *next, bool from_stdin,
+                               char **line, size_t *size) {
+    if (!from_stdin) {
+        return tokens_get_token(tokens, (*next)++);
+    }
+    ssize_t n;
+    while ((n = getline(line, size, stdin)) >= 0) {
+        if (n > 0 && (*line)[n - 1] == '\n') {
+            (*line)[--n] = '\0';
+        }
+        if (n > 0) { //blank lines aren't arguments
+            return *line;
+        }
+    }
+    return NULL;
+}
 
-        if (fundex >= 0) {
-            cmd_table[fundex].fun(tokens);
+/* Copies WORD into a new string with every {} replaced by ARG. */
+static char *substitute(const char *word, const char *arg) {
+    size_t count = 0, arg_len = strlen(arg);
+    for (const char *p = word; (p = strstr(p, "{}")) != NULL; p += 2) {
+        count++;
+    }
+    char *result = malloc(strlen(word) + count * arg_len + 1);
+    if (result == NULL) {
+        return NULL;
+    }
+    char *out = result;
+    for (const char *p = word; *p != '\0';) {
+        if (p[0] == '{' && p[1] == '}') {
+            memcpy(out, arg, arg_len);
+            out += arg_len;
+            p += 2;
         } else {
-            /* REPLACE this to run commands as programs. */
-            //plan:
-                //" fork a child process, which calls one of the 
-                //exec functions to run the new program. 
-                //The parent process should wait until the child process completes and 
-                //then continue listening for more commands."
-            
-                //so take the tokens of the input as arguments --> arguments[0] is the path, [1] is argument 1, etc
-                //use execv and run the program (path, arguments[])
-                //if its the parent, wait for child to be done 
-                //print errors when necessary
-            pid_t pid = fork(); //0 = child, - = error, + = parent
-            if (pid == 0) { //child
-                //give child its own process group
-                setpgid(0, 0); //makes the child the leader of a new process group (so not part of the shell’s group anymore)
-                //general form is like: setpgid(pid, pgid); where pid = the process whose group you want to change
-                //and pgid = the new process group ID 
-                //so basically making this process (pid = 0) be in a new group with its own PID (pgid = 0), making it the leader of its own group(?)
-                //^terminal signals only go to the child process group
-                //when foreground goes back to the shell, the signals are ignored again
-
-                tcsetpgrp(shell_terminal, getpid()); //put child process group in foreground
-                //let the child behave/respond to signals (default signal handling)
-                signal(SIGINT, SIG_DFL);
-                signal(SIGQUIT, SIG_DFL);
-                signal(SIGTSTP, SIG_DFL);
-                signal(SIGTTIN, SIG_DFL);
-                signal(SIGTTOU, SIG_DFL);
-                signal(SIGTERM, SIG_DFL);
-
-
-                size_t length = tokens_get_length(tokens); //the number of tokens (directory + arguments)
-                //char** is an array of strings (char* is a string with null as lest element but u can also just do a normal array)
-                char **arguments = malloc((length + 1) * sizeof(char *)); //the last one in the array should be NULL (so length+1)
-                for (size_t i = 0; i < length; i++) { //put the tokens into arguments array
-                    arguments[i] = tokens_get_token(tokens, i);
-                    // printf("%s\n", arguments[i]);
-                }
-                arguments[length] = NULL; //last element is NULL
-
-                //pt 5: doing IO redirection; need to do this before execv
-                int inpfd = -1; //these are the in/output file descriptors
-                int outpfd = -1; //-1 is default/file not opened yet
-
-                for (size_t i = 0; i < length; i++) { //go through all the tokens
-                    if (arguments[i] == NULL) continue; //skip if the arg entry is null
-
-                    if (strcmp(arguments[i], "<") == 0 && i + 1 < length) { //"if the arg is < and there is an argument after it too"
-                        inpfd = open(arguments[i + 1], O_RDONLY); //reads it and puts file descriptor in in_fd
-                        if (inpfd < 0) { //if u couldnt open it, print error
-                            perror("opening input file");
-                            exit(1);
-                        }
-                        //int dup2(int oldFileDescriptor, int newFileDescriptor);
-                        dup2(inpfd, STDIN_FILENO); //replace child’s standard input (fd = 0) with newly opened file's fd
-                        close(inpfd); //close the file!!! (its fd is copied to stdin now)
-                        //make the < and the file null so that execv doesnt see/use it later
-                        arguments[i] = NULL;
-                        arguments[i + 1] = NULL;
-                    } else if (strcmp(arguments[i], ">") == 0 && i + 1 < length) { //same but > 
-                        outpfd = open(arguments[i + 1], O_WRONLY | O_CREAT | O_TRUNC, 0666); //write, create, erase, permissions
-                        if (outpfd < 0) { //cant open file
-                            perror("opening output file");
-                            exit(1);
-                        }
-                        dup2(outpfd, STDOUT_FILENO); //replace stdout (fd = 1) with outpfd
-                        close(outpfd); 
-                        arguments[i] = NULL;
-                        arguments[i + 1] = NULL;
-                    }
-                }
+            *out++ = *p++;
+        }
+    }
+    *out = '\0';
+    return result;
+}
 
-                // execv(arguments[0], arguments); //try to run program
-                //****PT 4 modifies ^pt3 to ALSO allow use of "PATH variable from the environment to resolve program names"
-                    //plan:
-                        //if args[0] starts with '/' then keep it the same as pt 3 (the path is given)
-                        //otherwise:
-                            //need to look up PATH and get all the directories in a string (separated by ':')
-                            //append '/program_name' to each dir in the PATH's long string
-                            //put that path inside execv and try running program until it works or all directories were checked
-                
-                if (strchr(arguments[0], '/') != NULL) { //strchr gets first instance of / in args[0]
-                    execv(arguments[0], arguments); //same as pt 3
-                    perror("execv");
-                    exit(1);
-                }
+/* Starts COMMAND (tokens FIRST..LAST-1) for ARG in SLOT. Returns 0 if it's
+ * running. */
+static int parallel_start(struct parallel_slot *slot, struct tokens *tokens, size_t first,
+                          size_t last, const char *arg, int devnull) {
+    size_t argc = last - first;
+    bool placeholder = false;
+    for (size_t i = first; i < last; i++) {
+        placeholder = placeholder || strstr(tokens_get_token(tokens, i), "{}") != NULL;
+    }
+    if (!placeholder) {
+        argc++; //no {} anywhere: the argument goes on the end
+    }
+    char *argv[argc + 1];
+    size_t len = 0;
+    bool ok = true;
+    for (size_t i = 0; i < argc; i++) {
+        argv[i] = (i < last - first) ? substitute(tokens_get_token(tokens, first + i), arg)
+                                     : strdup(arg);
+        ok = ok && argv[i] != NULL;
+        len += (argv[i] != NULL) ? strlen(argv[i]) + 1 : 0;
+    }
+    argv[argc] = NULL;
 
-                //for PATH:
-                char *path = getenv("PATH"); //get the actual string
-                if (path == NULL) { //if it couldn't get the string then exit 
-                    fprintf(stderr, "couldn't get path string\n");
-                    exit(1);
-                }
+    int rc = -1;
+    //the words joined back up, for the report; only if every one of them exists
+    slot->command = ok ? malloc(len) : NULL;
+    slot->out = memfd_create("parallel", MFD_CLOEXEC);
+    if (slot->out < 0) {
+        perror("memfd_create");
+    }
+    if (slot->command != NULL) {
+        char *end = slot->command;
+        for (size_t i = 0; i < argc; i++) {
+            end = stpcpy(end, argv[i]);
+            *end++ = ' ';
+        }
+        end[-1] = '\0'; //argc > 0, so there's at least one word
+    }
+    ok = ok && slot->out >= 0 && slot->command != NULL;
+    if (ok) {
+        struct stage st = {.argv = argv, .argc = argc};
+        resolve_stage(&st);
+        clock_gettime(CLOCK_MONOTONIC, &slot->start);
+        //parallel's group; stdin is parallel's input, so the children get none
+        pid_t pid = spawn_stage(&st, getpgrp(), false, devnull, slot->out, slot->out,
+                                NULL, 0);
+        slot->job = (pid > 0) ? job_add(pid, &pid, 1, slot->command, false) : NULL;
+        rc = (slot->job != NULL) ? 0 : -1;
+        free(st.path);
+    }
+    for (size_t i = 0; i < argc; i++) {
+        free(argv[i]);
+    }
+    if (rc != 0) {
+        if (slot->out >= 0) {
+            close(slot->out);
+        }
+        free(slot->command);
+        slot->job = NULL;
+    }
+    return rc;
+}
 
-                char *pathCopy = strdup(path); //need to make copies bc strtok will directly modify the string
-                char *dir = strtok(pathCopy, ":"); //tokenize at each : (separate directories)
-                while (dir != NULL) {
-                    char fullPath[4096]; //decided to allocate space w/o using malloc; recommended on stack overflow to use 4096
-                    snprintf(fullPath, sizeof(fullPath), "%s/%s", dir, arguments[0]); //safer print for no buffer overflow
+/* Prints what SLOT's finished child wrote, then its report line, and frees
+ * the slot. Returns the child's wait status. */
+static int parallel_finish(struct parallel_slot *slot) {
+    double real = since(slot->start);
+    double user = seconds(slot->job->usage.ru_utime);
+    double sys = seconds(slot->job->usage.ru_stime);
+    int status = jobs_wait(slot->job); //already done: just collects it
 
-                    execv(fullPath, arguments); //try running program; if it fails, then go to next directory
-                    dir = strtok(NULL, ":"); //will only go here if execv failed (going to next :/directory)
+    fflush(stdout);
+    char buf[65536];
+    ssize_t n;
+    off_t off = 0;
+    while ((n = pread(slot->out, buf, sizeof(buf), off)) > 0) {
+        for (ssize_t done = 0, w; done < n; done += w) {
+            if ((w = write(STDOUT_FILENO, buf + done, n - done)) < 0) {
+                if (errno != EINTR) {
+                    perror("parallel: write");
+                    break;
                 }
+                w = 0;
+            }
+        }
+        off += n;
+    }
+    close(slot->out);
+
+    if (WIFEXITED(status)) {
+        fprintf(stderr, "parallel: exit %d", WEXITSTATUS(status));
+    } else {
+        fprintf(stderr, "parallel: killed by signal %d", WTERMSIG(status));
+    }
+    fprintf(stderr, ", %.3fs real, %.3fs user, %.3fs sys: %s\n", real, user, sys,
+            slot->command);
+    free(slot->command);
+    slot->job = NULL;
+    return status;
+}
+
+int cmd_parallel(struct tokens *tokens) {
+    size_t length = tokens_get_length(tokens);
+    size_t first = 1;
+    long njobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (first + 1 < length && strcmp(tokens_get_token(tokens, first), "-j") == 0) {
+        char *end;
+        njobs = strtol(tokens_get_token(tokens, first + 1), &end, 10);
+        if (*end != '\0' || njobs <= 0) {
+            fprintf(stderr, "parallel: -j needs a positive number\n");
+            return -1;
+        }
+        first += 2;
+    }
+    size_t last = first; //the command is tokens first..last-1
+    while (last < length && strcmp(tokens_get_token(tokens, last), ":::") != 0) {
+        last++;
+    }
+    if (last == first) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] command [args...] [::: arg...]\n");
+        return -1;
+    }
+    if (njobs < 1) {
+        njobs = 1;
+    }
+
+    //children are reaped through the signalfd, which only sees SIGCHLD while
+    //it's blocked; a forked parallel starts with nothing blocked
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+
+    struct parallel_slot *slots = calloc(njobs, sizeof(struct parallel_slot));
+    int devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (slots == NULL || devnull < 0) {
+        perror("parallel");
+        free(slots);
+        if (devnull >= 0) {
+            close(devnull);
+        }
+        return -1;
+    }
+    bool from_stdin = last == length;
+    size_t next = last + 1;
+    char *line = NULL;
+    size_t line_size = 0;
+    long running = 0, failed = 0;
+    bool more = true;
+
+    for (;;) {
+        //fill every free slot
+        for (long i = 0; i < njobs && more; i++) {
+            if (slots[i].job != NULL) {
+                continue;
+            }
+            char *arg = parallel_next_arg(tokens, &next, from_stdin, &line, &line_size);
+            if (arg == NULL) {
+                more = false;
+            } else if (parallel_start(&slots[i], tokens, first, last, arg, devnull) == 0) {
+                running++;
+            } else {
+                failed++;
+                i--; //the slot is still free
+            }
+        }
+        if (running == 0) {
+            break;
+        }
+        //collect whatever has finished, in any order; sleep if nothing has
+        bool any = false;
+        for (long i = 0; i < njobs; i++) {
+            if (slots[i].job != NULL && slots[i].job->state == JOB_DONE) {
+                int status = parallel_finish(&slots[i]);
+                failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+                running--;
+                any = true;
+            }
+        }
+        if (!any) {
+            jobs_wait_change();
+        }
+    }
+
+    free(line);
+    free(slots);
+    close(devnull);
+    return (failed == 0) ? 1 : -1;
+}
+
+/* Whether TOKENS has a | or ends in &, so it needs processes. */
+static bool needs_processes(struct tokens *tokens) {
+    size_t length = tokens_get_length(tokens);
+    for (size_t i = 0; i < length; i++) {
+        if (strcmp(tokens_get_token(tokens, i), "|") == 0) {
+            return true;
+        }
+    }
+    return length > 0 && strcmp(tokens_get_token(tokens, length - 1), "&") == 0;
+}
 
-                perror("execv"); //execv returning == an error (invalid path), so exit child process
-                exit(1); //exit with an error
-                //*NOTE:
-                    //so execv replaces the child process with /usr/bin/wc, so the waitpid
-                    //status that is stored in parent process should be 0 if everything went well
-                    //and 1 if the execv failed
-                    //either way, waitpid sees that the child finished, so we can move on
-            } else if (pid > 0) { //parent
-                int childCompleted; //somewhere to store child’s exit status
-                waitpid(pid, &childCompleted, 0); //0 flag == wait for child to exit normally
-                //wiat for THIS specific child to finish
-                tcsetpgrp(shell_terminal, shell_pgid); //now that the child is done, the shell goes back in the foreground
-            } else { //pid is negative == error
-                perror("fork");
+/* Whether FILE can't keep a reader or writer waiting: a regular file, or one
+ * that can't be opened at all (an error, not a wait). */
+static bool regular_or_missing(const char *file) {
+    struct stat st;
+    return stat(file, &st) != 0 || S_ISREG(st.st_mode);
+}
+
+/* Whether READS_ARGS/READS_STDIN built-in FUNDEX is sure to finish on its own
+ * for TOKENS: everything it reads or writes (operands, < and > files, and
+ * stdin if it reads that) is a regular file, not the tty, a pipe or a device. */
+static bool only_regular_files(int fundex, struct tokens *tokens) {
+    size_t length = tokens_get_length(tokens);
+    bool reads_stdin = cmd_table[fundex].interactive == READS_STDIN;
+    bool stdin_redirected = false;
+    size_t operands = 0;
+    for (size_t i = 1; i < length; i++) {
+        char *word = tokens_get_token(tokens, i);
+        if (strcmp(word, "<") == 0 || strcmp(word, ">") == 0) {
+            char *file = tokens_get_token(tokens, ++i);
+            if (file != NULL && !regular_or_missing(file)) {
+                return false;
+            }
+            stdin_redirected = stdin_redirected || word[0] == '<';
+        } else if (strcmp(word, "-") == 0) {
+            reads_stdin = true;
+            operands++;
+        } else if (word[0] != '-') { //not an option like tee -a
+            if (!regular_or_missing(word)) {
+                return false;
             }
+            operands++;
         }
+    }
+    if (operands == 0) {
+        reads_stdin = true; //cat with no files copies stdin
+    }
+    return !reads_stdin || stdin_redirected;
+}
+
+/* Whether built-in FUNDEX runs in the shell process for TOKENS, rather than
+ * through run_pipeline as a job. */
+static bool runs_in_shell(int fundex, struct tokens *tokens) {
+    if (shell_is_interactive) {
+        int mode = cmd_table[fundex].interactive;
+        if (mode == AS_JOB ||
+            ((mode == READS_ARGS || mode == READS_STDIN) && !only_regular_files(fundex, tokens))) {
+            return false;
+        }
+    }
+    return cmd_table[fundex].whole_line || !needs_processes(tokens);
+}
+
+//a built-in with < or > runs in the shell too: point fd 0/1 at the file, run
+//it, and put the shell's own fd back (a dup'd copy kept on the side)
+    //instead of forking a child just to hold the redirected fds
+
+/* Points TARGET at FILE (opened with FLAGS) and returns a copy of what
+ * TARGET was, to hand to restore_fd; -1 on error. */
+static int swap_fd(int target, const char *file, int flags) {
+    int fd = open(file, flags | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        perror(file);
+        return -1;
+    }
+    int saved = fcntl(target, F_DUPFD_CLOEXEC, 10); //out of the way of low fds
+    if (saved < 0 || dup2(fd, target) < 0) {
+        perror("dup2");
+        if (saved >= 0) {
+            close(saved);
+        }
+        saved = -1;
+    }
+    close(fd);
+    return saved;
+}
+
+static void restore_fd(int target, int saved) {
+    if (saved >= 0) {
+        dup2(saved, target);
+        close(saved);
+    }
+}
+
+/* Runs built-in FUNDEX in the shell process, with any < / > in TOKENS
+ * (which are taken out of them) applied by swapping fds. */
+static int run_builtin(int fundex, struct tokens *tokens) {
+    char *input = NULL, *output = NULL;
+    for (size_t i = 1; i < tokens_get_length(tokens);) {
+        char *token = tokens_get_token(tokens, i);
+        if (strcmp(token, "<") != 0 && strcmp(token, ">") != 0) {
+            i++;
+            continue;
+        }
+        char *file = tokens_get_token(tokens, i + 1);
+        if (file == NULL) {
+            fprintf(stderr, "syntax error: %s needs a file name\n", token);
+            return -1;
+        }
+        if (token[0] == '<') {
+            input = file;
+        } else {
+            output = file;
+        }
+        tokens_remove(tokens, i, 2); //the words stay in the line's memory
+    }
+    if (input == NULL && output == NULL) {
+        return cmd_table[fundex].fun(tokens);
+    }
+
+    fflush(stdout); //what's buffered belongs to the old stdout
+    int saved_in = -1, saved_out = -1;
+    if (input != NULL && (saved_in = swap_fd(STDIN_FILENO, input, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (output != NULL &&
+        (saved_out = swap_fd(STDOUT_FILENO, output, O_WRONLY | O_CREAT | O_TRUNC)) < 0) {
+        restore_fd(STDIN_FILENO, saved_in);
+        return -1;
+    }
+    int rc = cmd_table[fundex].fun(tokens);
+    fflush(stdout);
+    restore_fd(STDOUT_FILENO, saved_out);
+    restore_fd(STDIN_FILENO, saved_in);
+    return rc;
+}
+
+/* Waits until there's input, reaping children that finish in the meantime
+ * so background jobs never sit around as zombies. */
+static void wait_for_input(void) {
+    if (!shell_is_interactive || jobs_signal_fd() < 0) {
+        return; //a script's next line is already there; reap between lines
+    }
+    struct pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN},
+                            {.fd = jobs_signal_fd(), .events = POLLIN}};
+    while (poll(fds, 2, -1) >= 0 || errno == EINTR) {
+        if (fds[1].revents & POLLIN) {
+            jobs_reap();
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            return;
+        }
+    }
+}
+
+/* Runs one parsed line: a built-in in the shell, or else a pipeline. Returns
+ * an exit status (0 = success), like $? in sh. */
+static int run_command(struct tokens *tokens) {
+    //wildcards are expanded now, not when the line was read, so a script sees
+    //the files earlier commands made
+    if (tokens_expand(tokens) != 0) {
+        perror("glob");
+        return 1;
+    }
+    int fundex = lookup(tokens_get_token(tokens, 0));
+
+    if (fundex >= 0 && runs_in_shell(fundex, tokens)) {
+        double start = trace_enabled() ? trace_now() : 0;
+        int rc = needs_processes(tokens)
+                     ? cmd_table[fundex].fun(tokens) //time/parallel/limit do their own | and &
+                     : run_builtin(fundex, tokens);
+        if (trace_enabled()) {
+            trace_span("builtin", cmd_table[fundex].cmd, start, trace_now());
+        }
+        return builtin_status(rc);
+    } else if (tokens_get_length(tokens) > 0) {
+        //not a built-in on its own: run it as a program (or a pipeline, where
+        //built-in stages are forks of the shell)
+        //the shell waits until every stage completes and then continues
+        //listening for more commands
+        int status = run_pipeline(tokens, 0, NULL);
+        if (status == -1) {
+            return 127;
+        }
+        return WIFEXITED(status) ? WEXITSTATUS(status)
+               : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                     : 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
+
+//script mode: shell FILE, or shell -c "commands"
+    //read and tokenize the WHOLE script first, into one array of commands,
+    //then run the array; nothing is re-read or re-tokenized while it runs
+    //(and the script isn't on stdin, so commands can read stdin themselves)
+    //stdout gets one big buffer; it's flushed before anything else writes to fd 1
+    //blank lines and lines starting with # (like #!/path/to/shell) are skipped
+
+struct script {
+    struct tokens **commands;
+    size_t ncommands;
+    size_t capacity;
+};
+
+/* Tokenizes every line of IN into SCRIPT. Returns 0, or -1 on error. */
+static int script_parse(struct script *script, FILE *in) {
+    char *line = NULL;
+    size_t line_size = 0;
+    int rc = 0;
+    while (getline(&line, &line_size, in) >= 0) {
+        struct tokens *tokens = tokenize(line);
+        if (tokens == NULL) { //out of memory: lose this line, not the script
+            perror("tokenize");
+            continue;
+        }
+        char *first = tokens_get_token(tokens, 0);
+        if (first == NULL || first[0] == '#') {
+            tokens_destroy(tokens);
+            continue;
+        }
+        if (script->ncommands == script->capacity) {
+            size_t capacity = script->capacity ? 2 * script->capacity : 64;
+            struct tokens **grown = realloc(script->commands, capacity * sizeof(struct tokens *));
+            if (grown == NULL) {
+                perror("realloc");
+                tokens_destroy(tokens);
+                rc = -1;
+                break;
+            }
+            script->commands = grown;
+            script->capacity = capacity;
+        }
+        script->commands[script->ncommands++] = tokens;
+    }
+    free(line);
+    return rc;
+}
+
+static void script_free(struct script *script) {
+    for (size_t i = 0; i < script->ncommands; i++) {
+        tokens_destroy(script->commands[i]);
+    }
+    free(script->commands);
+}
+
+/* Runs `shell -c TEXT` (FILE == NULL) or `shell FILE`. Returns the exit status
+ * of the last command. */
+/* Writes to fd 2 for the script-mode stderr, after the buffered stdout. */
+static ssize_t stderr_write(unused void *cookie, const char *buf, size_t size) {
+    fflush(stdout); //or `script 2>&1` shows an error before the output above it
+    for (size_t done = 0; done < size;) {
+        ssize_t n = write(STDERR_FILENO, buf + done, size - done);
+        if (n < 0 && errno != EINTR) {
+            return (done > 0) ? (ssize_t) done : -1;
+        }
+        done += (n > 0) ? (size_t) n : 0;
+    }
+    return size;
+}
+
+static int run_script(const char *file, char *text) {
+    FILE *in = (file != NULL) ? fopen(file, "r") : fmemopen(text, strlen(text), "r");
+    if (in == NULL) {
+        perror(file != NULL ? file : "-c");
+        return 127;
+    }
+    struct script script = {0};
+    int rc = script_parse(&script, in);
+    fclose(in);
+    if (rc != 0) {
+        script_free(&script);
+        return 2;
+    }
+
+    static char out_buffer[1 << 16];
+    setvbuf(stdout, out_buffer, _IOFBF, sizeof(out_buffer));
+    //stdout is held back now, but stderr isn't; every message the shell or a
+    //built-in writes to stderr goes out after what stdout has so far
+    FILE *err = fopencookie(NULL, "w", (cookie_io_functions_t) {.write = stderr_write});
+    if (err != NULL) {
+        setvbuf(err, NULL, _IONBF, 0);
+        stderr = err;
+    }
+    int status = 0;
+    for (size_t i = 0; i < script.ncommands; i++) {
+        status = run_command(script.commands[i]);
+        //report background jobs that finished since the last command
+        jobs_reap();
+        jobs_notify(stdout);
+    }
+    fflush(stdout);
+    script_free(&script);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    init_shell();
+    trace_init();
+
+    if (argc > 2 && strcmp(argv[1], "-c") == 0) {
+        return run_script(NULL, argv[2]);
+    } else if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        fprintf(stderr, "%s: -c needs an argument\n", argv[0]);
+        return 2;
+    } else if (argc > 1) {
+        return run_script(argv[1], NULL);
+    }
+
+    char *line = NULL; //grown by getline to fit the longest line so far
+    size_t line_size = 0;
+    int line_num = 0;
+
+    /* Only print shell prompts when standard input is not a tty */
+    if (shell_is_interactive) {
+        fprintf(stdout, "%d: ", line_num);
+    }
+
+    wait_for_input();
+    while (getline(&line, &line_size, stdin) >= 0) {
+        /* Split our line into words. */
+        struct tokens *tokens = tokenize(line);
+
+        if (tokens == NULL) { //out of memory: skip the line, keep the shell
+            perror("tokenize");
+        } else {
+            run_command(tokens);
+        }
+
+        //report background jobs that finished since the last prompt
+        jobs_reap();
+        jobs_notify(stdout);
 
         if (shell_is_interactive) {
             /* Only print shell prompts when standard input is not a tty. */
@@ -296,7 +1334,10 @@ int main(unused int argc, unused char *argv[]) {
 
         /* Clean up memory. */
         tokens_destroy(tokens);
+        fflush(stdout);
+        wait_for_input();
     }
 
+    free(line);
     return 0;
 }
@@ -0,0 +1,20 @@
+#ifndef SHELL_H_
+#define SHELL_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <termios.h>
+
+/* Whether the shell is connected to an actual terminal or not. */
+extern bool shell_is_interactive;
+
+/* File descriptor for the shell input */
+extern int shell_terminal;
+
+/* Terminal mode settings for the shell */
+extern struct termios shell_tmodes;
+
+/* Process group id for the shell */
+extern pid_t shell_pgid;
+
+#endif
@@ -0,0 +1,131 @@
+/* Checks that ctrl-c and ctrl-z at the prompt reach a running `parallel` and
+ * its children: runs ./shell on a pseudo-terminal, starts sleeps that would
+ * take a minute, and expects the shell to take commands again within a few
+ * seconds of each key. Exits 0 if every step passes. */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STEP_TIMEOUT_MS 5000
+
+static int master;
+static char output[1 << 16]; //everything the shell has written so far
+static size_t output_len;
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Reads from the shell until NEEDLE shows up after offset FROM, or the step
+ * times out. Returns the offset just past it, or 0. */
+static size_t expect(const char *needle, size_t from) {
+    long deadline = now_ms() + STEP_TIMEOUT_MS;
+    for (;;) {
+        output[output_len] = '\0';
+        char *found = strstr(output + from, needle);
+        if (found != NULL) {
+            return found - output + strlen(needle);
+        }
+        long left = deadline - now_ms();
+        struct pollfd p = {.fd = master, .events = POLLIN};
+        if (left <= 0 || poll(&p, 1, left) <= 0) {
+            return 0;
+        }
+        ssize_t n = read(master, output + output_len, sizeof(output) - 1 - output_len);
+        if (n <= 0) {
+            return 0;
+        }
+        output_len += n;
+    }
+}
+
+static void type(const char *keys) {
+    if (write(master, keys, strlen(keys)) < 0) {
+        perror("write");
+    }
+}
+
+/* Types ctrl-c (or another signal key) and gives the shell time to act on it:
+ * the tty throws away whatever was typed before it handles the key. */
+static void press(const char *key) {
+    type(key);
+    usleep(300 * 1000);
+}
+
+static bool step(const char *name, const char *keys, const char *needle, size_t *at) {
+    if (keys != NULL) {
+        type(keys);
+    }
+    size_t found = expect(needle, *at);
+    printf("%-40s %s\n", name, found != 0 ? "ok" : "FAILED");
+    if (found == 0) {
+        fprintf(stderr, "--- shell output so far ---\n%s\n---\n", output + *at);
+        return false;
+    }
+    *at = found;
+    return true;
+}
+
+int main(void) {
+    pid_t pid = forkpty(&master, NULL, NULL, NULL);
+    if (pid < 0) {
+        perror("forkpty");
+        return 1;
+    }
+    if (pid == 0) {
+        execl("./shell", "shell", (char *) NULL);
+        perror("./shell");
+        _exit(127);
+    }
+
+    //each check echoes a word with "" in it: the tty echoes what was typed,
+    //so only the command's output has the word whole
+    size_t at = 0;
+    bool ok = step("shell starts", "echo re\"\"ady\n", "ready", &at);
+    if (ok) {
+        type("parallel -j 2 sleep ::: 30 30 30\n");
+        usleep(500 * 1000); //long enough for both sleeps to start
+        press("\003");
+        ok = step("ctrl-c stops parallel", "echo after-\"\"interrupt\n", "after-interrupt",
+                  &at);
+    }
+    if (ok) {
+        type("parallel -j 2 sleep ::: 30 30\n");
+        usleep(500 * 1000);
+        ok = step("ctrl-z stops parallel", "\032", "Stopped", &at) &&
+             step("stopped parallel is a job", "jobs\n", "Stopped \tparallel", &at);
+    }
+    if (ok) {
+        type("fg\n");
+        usleep(500 * 1000);
+        press("\003");
+        ok = step("fg, then ctrl-c ends it", "echo after-\"\"fg\n", "after-fg", &at);
+    }
+    if (ok) {
+        size_t before = at;
+        ok = step("jobs runs", "jobs\necho no-\"\"jobs\n", "no-jobs", &at);
+        output[at] = '\0';
+        if (ok && strstr(output + before, "[1]") != NULL) {
+            printf("%-40s FAILED\n", "no jobs are left");
+            ok = false;
+        }
+    }
+
+    type("exit\n");
+    kill(pid, SIGHUP);
+    waitpid(pid, NULL, 0);
+    return ok ? 0 : 1;
+}
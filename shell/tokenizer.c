@@ -1,28 +1,101 @@
 #include "tokenizer.h"
 
 #include <ctype.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "wildcard.h"
+
+/* Everything for one line lives in two allocations: this struct with the
+ * line's text after it, and the array of token pointers. Unquoting never makes
+ * a word longer than its source and every word but the last ends where a space
+ * was, so the words are written back over the copied line in place.
+ *
+ * Only words with an unquoted * ? or [ cost more: PATTERNS (allocated on the
+ * first one) says which words tokens_expand should expand, and BUFFERS holds
+ * whatever they needed (a re-quoted pattern, the expanded paths). */
 struct tokens {
     size_t tokens_length;
+    size_t tokens_capacity;
     char **tokens;
+    char **patterns;
     size_t buffers_length;
+    size_t buffers_capacity;
     char **buffers;
+    char text[];
 };
 
-static void *vector_push(char ***pointer, size_t *size, void *elem) {
-    *pointer = (char **) realloc(*pointer, sizeof(char *) * (*size + 1));
-    (*pointer)[*size] = elem;
-    *size += 1;
-    return elem;
+static int push_token(struct tokens *tokens, char *word, char *pattern) {
+    if (tokens->tokens_length == tokens->tokens_capacity) {
+        size_t capacity = tokens->tokens_capacity ? 2 * tokens->tokens_capacity : 8;
+        char **grown = (char **) realloc(tokens->tokens, sizeof(char *) * capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        tokens->tokens = grown;
+        if (tokens->patterns != NULL) {
+            grown = (char **) realloc(tokens->patterns, sizeof(char *) * capacity);
+            if (grown == NULL) {
+                return -1;
+            }
+            tokens->patterns = grown;
+            memset(grown + tokens->tokens_capacity, 0,
+                   sizeof(char *) * (capacity - tokens->tokens_capacity));
+        }
+        tokens->tokens_capacity = capacity;
+    }
+    if (pattern != NULL && tokens->patterns == NULL) {
+        tokens->patterns = (char **) calloc(tokens->tokens_capacity, sizeof(char *));
+        if (tokens->patterns == NULL) {
+            return -1;
+        }
+    }
+    if (tokens->patterns != NULL) {
+        tokens->patterns[tokens->tokens_length] = pattern;
+    }
+    tokens->tokens[tokens->tokens_length++] = word;
+    return 0;
+}
+
+/* Hands BUFFER to TOKENS to free in tokens_destroy. */
+static int keep_buffer(struct tokens *tokens, char *buffer) {
+    if (tokens->buffers_length == tokens->buffers_capacity) {
+        size_t capacity = tokens->buffers_capacity ? 2 * tokens->buffers_capacity : 4;
+        char **grown = (char **) realloc(tokens->buffers, sizeof(char *) * capacity);
+        if (grown == NULL) {
+            free(buffer);
+            return -1;
+        }
+        tokens->buffers = grown;
+        tokens->buffers_capacity = capacity;
+    }
+    tokens->buffers[tokens->buffers_length++] = buffer;
+    return 0;
 }
 
-static void *copy_word(char *source, size_t n) {
-    source[n] = '\0';
-    char *word = (char *) malloc(n + 1);
-    strncpy(word, source, n + 1);
-    return word;
+/* The glob pattern for WORD (LENGTH bytes): WORD itself, unless some of its
+ * special characters were quoted, in which case a copy with those NLITERAL
+ * characters (at offsets LITERAL) backslash-quoted. */
+static char *make_pattern(struct tokens *tokens, char *word, size_t length,
+                          const size_t *literal, size_t nliteral) {
+    if (nliteral == 0) {
+        return word;
+    }
+    char *pattern = (char *) malloc(length + nliteral + 1);
+    if (pattern == NULL || keep_buffer(tokens, pattern) != 0) {
+        return NULL;
+    }
+    char *p = pattern;
+    for (size_t i = 0, k = 0; i < length; i++) {
+        if (k < nliteral && literal[k] == i) {
+            *p++ = '\\';
+            k++;
+        }
+        *p++ = word[i];
+    }
+    *p = '\0';
+    return pattern;
 }
 
 struct tokens *tokenize(const char *line) {
@@ -30,73 +103,141 @@ struct tokens *tokenize(const char *line) {
         return NULL;
     }
 
-    static char token[4096];
-    size_t n = 0, n_max = 4096;
-    struct tokens *tokens;
     size_t line_length = strlen(line);
-
-    tokens = (struct tokens *) malloc(sizeof(struct tokens));
+    struct tokens *tokens = (struct tokens *) malloc(sizeof(struct tokens) + line_length + 1);
+    if (tokens == NULL) {
+        return NULL;
+    }
     tokens->tokens_length = 0;
+    tokens->tokens_capacity = 0;
     tokens->tokens = NULL;
+    tokens->patterns = NULL;
     tokens->buffers_length = 0;
+    tokens->buffers_capacity = 0;
     tokens->buffers = NULL;
+    memcpy(tokens->text, line, line_length + 1);
 
     const int MODE_NORMAL = 0, MODE_SQUOTE = 1, MODE_DQUOTE = 2;
     int mode = MODE_NORMAL;
+    char *in = tokens->text, *end = tokens->text + line_length;
+    char *out = tokens->text; /* Never ahead of in. */
+    char *word = NULL;        /* Start of the word being built, if any. */
+    bool wild = false;        /* The word has an unquoted * ? or [. */
+    size_t *literal = NULL;   /* Offsets of quoted special characters in it. */
+    size_t nliteral = 0, literal_capacity = 0;
 
-    for (unsigned int i = 0; i < line_length; i++) {
-        char c = line[i];
-        if (mode == MODE_NORMAL) {
-            if (c == '\'') {
-                mode = MODE_SQUOTE;
-            } else if (c == '"') {
-                mode = MODE_DQUOTE;
-            } else if (c == '\\') {
-                if (i + 1 < line_length) {
-                    token[n++] = line[++i];
-                }
-            } else if (isspace(c)) {
-                if (n > 0) {
-                    void *word = copy_word(token, n);
-                    vector_push(&tokens->tokens, &tokens->tokens_length, word);
-                    n = 0;
+    while (in <= end) {
+        bool at_end = in == end; /* Finishes the last word, even inside quotes. */
+        char c = at_end ? ' ' : *in;
+        in++;
+        if (at_end || (mode == MODE_NORMAL && isspace((unsigned char) c))) {
+            if (word != NULL && out > word) { /* '' alone isn't a word */
+                char *pattern = wild ? make_pattern(tokens, word, out - word, literal, nliteral)
+                                     : NULL;
+                *out = '\0';
+                out += !at_end; /* The last word's \0 takes the line's own. */
+                if ((wild && pattern == NULL) || push_token(tokens, word, pattern) != 0) {
+                    free(literal);
+                    tokens_destroy(tokens);
+                    return NULL;
                 }
-            } else {
-                token[n++] = c;
             }
-        } else if (mode == MODE_SQUOTE) {
-            if (c == '\'') {
-                mode = MODE_NORMAL;
-            } else if (c == '\\') {
-                if (i + 1 < line_length) {
-                    token[n++] = line[++i];
-                }
-            } else {
-                token[n++] = c;
+            word = NULL;
+            wild = false;
+            nliteral = 0;
+            continue;
+        }
+        if (word == NULL) {
+            word = out;
+        }
+        bool quoted = mode != MODE_NORMAL;
+        if (c == '\\') {
+            if (in >= end) {
+                continue;
             }
-        } else if (mode == MODE_DQUOTE) {
-            if (c == '"') {
-                mode = MODE_NORMAL;
-            } else if (c == '\\') {
-                if (i + 1 < line_length) {
-                    token[n++] = line[++i];
+            c = *in++;
+            quoted = true;
+        } else if (mode == MODE_NORMAL && c == '\'') {
+            mode = MODE_SQUOTE;
+            continue;
+        } else if (mode == MODE_NORMAL && c == '"') {
+            mode = MODE_DQUOTE;
+            continue;
+        } else if ((mode == MODE_SQUOTE && c == '\'') || (mode == MODE_DQUOTE && c == '"')) {
+            mode = MODE_NORMAL;
+            continue;
+        }
+        if (!quoted && (c == '*' || c == '?' || c == '[')) {
+            wild = true;
+        } else if (quoted && wildcard_special(c)) {
+            if (nliteral == literal_capacity) {
+                literal_capacity = literal_capacity ? 2 * literal_capacity : 8;
+                size_t *grown = (size_t *) realloc(literal, sizeof(size_t) * literal_capacity);
+                if (grown == NULL) {
+                    free(literal);
+                    tokens_destroy(tokens);
+                    return NULL;
                 }
-            } else {
-                token[n++] = c;
+                literal = grown;
             }
+            literal[nliteral++] = out - word;
         }
-        if (n + 1 >= n_max)
-            abort();
+        *out++ = c;
     }
+    free(literal);
+    return tokens;
+}
 
-    if (n > 0) {
-        void *word = copy_word(token, n);
-        vector_push(&tokens->tokens, &tokens->tokens_length, word);
-        n = 0;
+struct tokens *tokens_from_words(char **words, size_t n) {
+    struct tokens *tokens = (struct tokens *) calloc(1, sizeof(struct tokens) + 1);
+    if (tokens == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (push_token(tokens, words[i], NULL) != 0) {
+            tokens_destroy(tokens);
+            return NULL;
+        }
     }
     return tokens;
 }
 
+int tokens_expand(struct tokens *tokens) {
+    if (tokens == NULL || tokens->patterns == NULL) {
+        return 0; /* No wildcards: nothing to do. */
+    }
+    struct wildcard_cache *cache = wildcard_cache_new();
+    char **words = tokens->tokens, **patterns = tokens->patterns;
+    size_t length = tokens->tokens_length;
+    tokens->tokens = NULL;
+    tokens->patterns = NULL;
+    tokens->tokens_length = 0;
+    tokens->tokens_capacity = 0;
+
+    int rc = (cache != NULL) ? 0 : -1;
+    for (size_t i = 0; i < length && rc == 0; i++) {
+        struct wildcard_matches matches = {0};
+        if (patterns[i] == NULL || wildcard_expand(cache, patterns[i], &matches) != 0 ||
+            matches.count == 0) {
+            free(matches.text);
+            rc = push_token(tokens, words[i], NULL); /* No match: the word stays as is. */
+            continue;
+        }
+        if ((rc = keep_buffer(tokens, matches.text)) != 0) {
+            break;
+        }
+        char *match = matches.text;
+        for (size_t k = 0; k < matches.count && rc == 0; k++) {
+            rc = push_token(tokens, match, NULL);
+            match += strlen(match) + 1;
+        }
+    }
+    free(words);
+    free(patterns);
+    wildcard_cache_free(cache);
+    return rc;
+}
+
 size_t tokens_get_length(struct tokens *tokens) {
     if (tokens == NULL) {
         return 0;
@@ -113,18 +254,31 @@ char *tokens_get_token(struct tokens *tokens, size_t n) {
     }
 }
 
+void tokens_remove(struct tokens *tokens, size_t n, size_t count) {
+    if (tokens == NULL || n >= tokens->tokens_length) {
+        return;
+    }
+    if (count > tokens->tokens_length - n) {
+        count = tokens->tokens_length - n;
+    }
+    memmove(&tokens->tokens[n], &tokens->tokens[n + count],
+            sizeof(char *) * (tokens->tokens_length - n - count));
+    if (tokens->patterns != NULL) {
+        memmove(&tokens->patterns[n], &tokens->patterns[n + count],
+                sizeof(char *) * (tokens->tokens_length - n - count));
+    }
+    tokens->tokens_length -= count;
+}
+
 void tokens_destroy(struct tokens *tokens) {
     if (tokens == NULL) {
         return;
     }
-    for (int i = 0; i < tokens->tokens_length; i++) {
-        free(tokens->tokens[i]);
-    }
-    for (int i = 0; i < tokens->buffers_length; i++) {
+    for (size_t i = 0; i < tokens->buffers_length; i++) {
         free(tokens->buffers[i]);
     }
-    if (tokens->tokens) {
-        free(tokens->tokens);
-    }
+    free(tokens->buffers);
+    free(tokens->patterns);
+    free(tokens->tokens);
     free(tokens);
 }
@@ -9,12 +9,23 @@ struct tokens;
 /* Turn a string into a list of words. */
 struct tokens *tokenize(const char *line);
 
+/* A word list holding the N words in WORDS (not copies: they must outlive it). */
+struct tokens *tokens_from_words(char **words, size_t n);
+
 /* How many words are there? */
 size_t tokens_get_length(struct tokens *tokens);
 
 /* Get me the Nth word (zero-indexed) */
 char *tokens_get_token(struct tokens *tokens, size_t n);
 
+/* Replace every word that has an unquoted * ? or [ with the paths it
+ * matches, sorted (a word that matches nothing stays as it is). Returns 0, or
+ * -1 if out of memory. */
+int tokens_expand(struct tokens *tokens);
+
+/* Drop COUNT words starting at the Nth; later words move down. */
+void tokens_remove(struct tokens *tokens, size_t n, size_t count);
+
 /* Free the memory */
 void tokens_destroy(struct tokens *tokens);
 
@@ -0,0 +1,178 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+//SHELL_TRACE=file: where does a command's time go?
+    //on the shell's line (tid = shell pid): path lookup, spawn (= fork + exec,
+    //posix_spawn only returns once the exec worked), waiting, built-ins
+    //on each child's own line (tid = its pid): spawned -> reaped
+    //format: Chrome trace events ("ph":"X" = a span with a duration), open in
+    //chrome://tracing or ui.perfetto.dev; the file is one JSON object, closed at exit
+//launch overhead (lookup + spawn) also goes in a log2 histogram, printed at exit
+
+#define NBUCKETS 24 //1us .. 8s
+
+static FILE *trace_file;
+static bool first_event = true;
+static pid_t shell_pid;
+
+static unsigned long histogram[NBUCKETS];
+static unsigned long launches;
+static double launch_total;
+
+/* A child that's been spawned but not reaped yet. */
+struct running {
+    pid_t pid;
+    double start;
+    char *what;
+};
+static struct running *running;
+static size_t nrunning, running_capacity;
+
+bool trace_enabled(void) {
+    return trace_file != NULL;
+}
+
+double trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Writes S as a JSON string. */
+static void write_string(const char *s) {
+    fputc('"', trace_file);
+    for (; *s != '\0'; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(trace_file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(trace_file, "\\u%04x", c);
+        } else {
+            fputc(c, trace_file);
+        }
+    }
+    fputc('"', trace_file);
+}
+
+static void write_event(const char *name, const char *what, pid_t tid, double start,
+                        double end, const char *extra) {
+    fprintf(trace_file, "%s\n{\"name\":", first_event ? "" : ",");
+    first_event = false;
+    write_string(name);
+    fprintf(trace_file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                        "\"args\":{\"command\":",
+            start, end - start, (int) shell_pid, (int) tid);
+    write_string(what);
+    fprintf(trace_file, "%s}}", extra != NULL ? extra : "");
+}
+
+void trace_span(const char *name, const char *what, double start, double end) {
+    if (trace_file != NULL) {
+        write_event(name, what, shell_pid, start, end, NULL);
+    }
+}
+
+void trace_spawn(pid_t pid, const char *what, double lookup, double start, double end) {
+    if (trace_file == NULL) {
+        return;
+    }
+    write_event("spawn", what, shell_pid, start, end, NULL);
+
+    double overhead = lookup + (end - start);
+    int b = 0;
+    while (b < NBUCKETS - 1 && overhead >= (double) (2UL << b)) {
+        b++;
+    }
+    histogram[b]++;
+    launches++;
+    launch_total += overhead;
+
+    if (nrunning == running_capacity) {
+        size_t capacity = running_capacity ? 2 * running_capacity : 16;
+        struct running *grown = realloc(running, capacity * sizeof(struct running));
+        if (grown == NULL) {
+            return; //the run just won't show up
+        }
+        running = grown;
+        running_capacity = capacity;
+    }
+    running[nrunning].pid = pid;
+    running[nrunning].start = end;
+    running[nrunning].what = strdup(what);
+    nrunning++;
+}
+
+void trace_reap(pid_t pid, int status) {
+    if (trace_file == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < nrunning; i++) {
+        if (running[i].pid != pid) {
+            continue;
+        }
+        char extra[64];
+        snprintf(extra, sizeof(extra), ",\"status\":%d",
+                 WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+        write_event("run", running[i].what != NULL ? running[i].what : "", pid,
+                    running[i].start, trace_now(), extra);
+        free(running[i].what);
+        running[i] = running[--nrunning];
+        return;
+    }
+}
+
+void trace_flush(void) {
+    if (trace_file != NULL) {
+        fflush(trace_file);
+    }
+}
+
+static void trace_finish(void) {
+    if (getpid() != shell_pid) {
+        return; //never from a child
+    }
+    fprintf(trace_file, "\n]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+
+    if (launches == 0) {
+        return;
+    }
+    unsigned long most = 0;
+    for (int b = 0; b < NBUCKETS; b++) {
+        most = (histogram[b] > most) ? histogram[b] : most;
+    }
+    fprintf(stderr, "%lu launches, %.1f us average overhead (path lookup + spawn):\n",
+            launches, launch_total / launches);
+    for (int b = 0; b < NBUCKETS; b++) {
+        if (histogram[b] == 0) {
+            continue;
+        }
+        int bar = (int) (histogram[b] * 50 / most);
+        fprintf(stderr, "  %8lu - %8lu us %8lu ", b ? 1UL << b : 0, 2UL << b, histogram[b]);
+        for (int i = 0; i < (bar ? bar : 1); i++) {
+            fputc('#', stderr);
+        }
+        fputc('\n', stderr);
+    }
+}
+
+void trace_init(void) {
+    const char *file = getenv("SHELL_TRACE");
+    if (file == NULL || file[0] == '\0') {
+        return;
+    }
+    if ((trace_file = fopen(file, "we")) == NULL) {
+        perror(file);
+        return;
+    }
+    shell_pid = getpid();
+    fprintf(trace_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    atexit(trace_finish);
+}
@@ -0,0 +1,32 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Opens $SHELL_TRACE (if set) for Chrome trace-event JSON, and arranges for
+ * it to be closed and the launch summary printed at exit. */
+void trace_init(void);
+
+/* Whether tracing is on; every other call is a no-op when it isn't. */
+bool trace_enabled(void);
+
+/* Microseconds on the monotonic clock, the timestamps the trace uses. */
+double trace_now(void);
+
+/* Records a span NAME (about WHAT) on the shell's own timeline. */
+void trace_span(const char *name, const char *what, double start, double end);
+
+/* Records the launch of PID (running WHAT) that took from START to END: the
+ * spawn span, plus the process's own timeline until trace_reap. LOOKUP is how
+ * long finding the program took, which counts as launch overhead too. */
+void trace_spawn(pid_t pid, const char *what, double lookup, double start, double end);
+
+/* Records that PID was reaped with wait status STATUS. */
+void trace_reap(pid_t pid, int status);
+
+/* Writes out whatever is buffered; call before fork() so the child's copy of
+ * the buffer is empty. */
+void trace_flush(void);
+
+#endif
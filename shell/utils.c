@@ -0,0 +1,345 @@
+#define _GNU_SOURCE
+
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define unused __attribute__((unused))
+
+//these run inside the shell, so they must never exit() or leave fds open,
+//and they read/write the real fds 0 and 1 (which a redirection may have
+//swapped) just like the programs they stand in for
+
+int cmd_true(unused struct tokens *tokens) {
+    return 1;
+}
+
+int cmd_false(unused struct tokens *tokens) {
+    return -1;
+}
+
+int cmd_echo(struct tokens *tokens) {
+    size_t i = 1;
+    bool newline = true;
+    if (tokens_get_token(tokens, i) != NULL && strcmp(tokens_get_token(tokens, i), "-n") == 0) {
+        newline = false;
+        i++;
+    }
+    for (size_t first = i; i < tokens_get_length(tokens); i++) {
+        if (i > first) {
+            putchar(' ');
+        }
+        fputs(tokens_get_token(tokens, i), stdout);
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 1;
+}
+
+/* Copies all of FD to stdout. Returns 0, or -1 with errno set. */
+static int copy_out(int fd) {
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (ssize_t done = 0, w; done < n; done += w) {
+            if ((w = write(STDOUT_FILENO, buf + done, n - done)) < 0) {
+                if (errno != EINTR) {
+                    return -1;
+                }
+                w = 0;
+            }
+        }
+    }
+    return 0;
+}
+
+int cmd_cat(struct tokens *tokens) {
+    size_t length = tokens_get_length(tokens);
+    int rc = 1;
+    fflush(stdout); //anything echo left buffered comes first
+    for (size_t i = (length > 1) ? 1 : 0; i < length; i++) {
+        //no arguments = one pass over stdin (i == 0 stands for it)
+        char *name = (i == 0) ? "-" : tokens_get_token(tokens, i);
+        int fd = (strcmp(name, "-") == 0) ? STDIN_FILENO : open(name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || copy_out(fd) != 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            rc = -1;
+        }
+        if (fd > STDIN_FILENO) {
+            close(fd);
+        }
+    }
+    return rc;
+}
+
+//tee: the data never has to come into the shell when it can stay in pipe buffers
+    //tee(2) duplicates what's in the stdin pipe into the stdout pipe WITHOUT
+    //consuming it; the same bytes are then tee'd into a scratch pipe and spliced
+    //to each file but the last, and the last splice consumes them from stdin
+    //a scratch pipe with as many slots as stdin's can always take what stdin
+    //holds, so every file gets exactly the bytes stdout got
+    //needs stdin and stdout to be pipes and the files to be regular; anything
+    //else (a terminal, a file as stdin) goes through one big buffer instead
+
+#define TEE_BUFFER (1 << 20)
+
+static bool is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/* Splices exactly N bytes from pipe IN to FD. */
+static int splice_all(int in, int fd, size_t n) {
+    while (n > 0) {
+        ssize_t moved = splice(in, NULL, fd, NULL, n, SPLICE_F_MOVE);
+        if (moved <= 0) {
+            if (moved < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        n -= moved;
+    }
+    return 0;
+}
+
+static int tee_splice(const int *files, int nfiles) {
+    int scratch[2] = {-1, -1};
+    if (nfiles > 1) {
+        if (pipe2(scratch, O_CLOEXEC) != 0) {
+            return -1;
+        }
+        int size = fcntl(STDIN_FILENO, F_GETPIPE_SZ);
+        if (size > 0 && fcntl(scratch[1], F_SETPIPE_SZ, size) < size) {
+            close(scratch[0]);
+            close(scratch[1]);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    int rc = 0;
+    for (;;) {
+        ssize_t n = (nfiles == 0)
+                        ? splice(STDIN_FILENO, NULL, STDOUT_FILENO, NULL, TEE_BUFFER, SPLICE_F_MOVE)
+                        : tee(STDIN_FILENO, STDOUT_FILENO, TEE_BUFFER, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            rc = (n < 0) ? -1 : 0;
+            break;
+        }
+        for (int i = 0; i + 1 < nfiles && rc == 0; i++) {
+            ssize_t copied = tee(STDIN_FILENO, scratch[1], n, 0);
+            if (copied != n) { //can't happen with an empty pipe as big as stdin
+                errno = (copied < 0) ? errno : EIO;
+                rc = -1;
+            } else {
+                rc = splice_all(scratch[0], files[i], n);
+            }
+        }
+        if (rc == 0 && nfiles > 0) {
+            rc = splice_all(STDIN_FILENO, files[nfiles - 1], n); //consumes them
+        }
+        if (rc != 0) {
+            break;
+        }
+    }
+    if (scratch[0] >= 0) {
+        close(scratch[0]);
+        close(scratch[1]);
+    }
+    return rc;
+}
+
+static int write_all(int fd, const char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, buf, n);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += w;
+        n -= w;
+    }
+    return 0;
+}
+
+static int tee_copy(const int *files, int nfiles) {
+    char *buf = malloc(TEE_BUFFER);
+    if (buf == NULL) {
+        return -1;
+    }
+    int rc = 0;
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buf, TEE_BUFFER)) != 0 && rc == 0) {
+        if (n < 0) {
+            rc = (errno == EINTR) ? 0 : -1;
+            continue;
+        }
+        rc = write_all(STDOUT_FILENO, buf, n);
+        for (int i = 0; i < nfiles && rc == 0; i++) {
+            rc = write_all(files[i], buf, n);
+        }
+    }
+    free(buf);
+    return rc;
+}
+
+static int tee_main(int argc, char **argv) {
+    int first = 1;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC;
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        flags = (flags & ~O_TRUNC) | O_APPEND;
+        first++;
+    }
+    int nfiles = 0;
+    int files[argc > first ? argc - first : 1];
+    bool splice_ok = is_pipe(STDIN_FILENO) && is_pipe(STDOUT_FILENO);
+    int status = 0;
+    for (int i = first; i < argc; i++) {
+        int fd = open(argv[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "tee: %s: %s\n", argv[i], strerror(errno));
+            status = 1; //like tee(1): the other outputs still get everything
+            continue;
+        }
+        struct stat st;
+        splice_ok = splice_ok && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                    !(flags & O_APPEND); //splice refuses O_APPEND files
+        files[nfiles++] = fd;
+    }
+
+    int rc = splice_ok ? tee_splice(files, nfiles) : tee_copy(files, nfiles);
+    if (rc != 0) {
+        perror("tee");
+        status = 1;
+    }
+    for (int i = 0; i < nfiles; i++) {
+        close(files[i]);
+    }
+    return status;
+}
+
+int cmd_tee(struct tokens *tokens) {
+    size_t argc = tokens_get_length(tokens);
+    char *argv[argc + 1];
+    for (size_t i = 0; i <= argc; i++) {
+        argv[i] = tokens_get_token(tokens, i);
+    }
+    fflush(stdout);
+    return (tee_main(argc, argv) == 0) ? 1 : -1;
+}
+
+/* A whole number for -eq etc, or an error. */
+static bool parse_int(const char *s, long *value) {
+    char *end;
+    errno = 0;
+    *value = strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        return false;
+    }
+    return true;
+}
+
+/* Evaluates the ARGC words in ARGV: 1 = true, 0 = false, -1 = bad syntax. */
+static int evaluate(size_t argc, char **argv) {
+    if (argc > 0 && strcmp(argv[0], "!") == 0) {
+        int result = evaluate(argc - 1, argv + 1);
+        return (result < 0) ? result : !result;
+    }
+    if (argc == 0) {
+        return 0;
+    }
+    if (argc == 1) {
+        return argv[0][0] != '\0';
+    }
+    if (argc == 2) {
+        const char *op = argv[0], *arg = argv[1];
+        struct stat st;
+        if (strcmp(op, "-n") == 0) {
+            return arg[0] != '\0';
+        } else if (strcmp(op, "-z") == 0) {
+            return arg[0] == '\0';
+        } else if (strcmp(op, "-L") == 0 || strcmp(op, "-h") == 0) {
+            return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        } else if (strcmp(op, "-r") == 0) {
+            return access(arg, R_OK) == 0;
+        } else if (strcmp(op, "-w") == 0) {
+            return access(arg, W_OK) == 0;
+        } else if (strcmp(op, "-x") == 0) {
+            return access(arg, X_OK) == 0;
+        }
+        bool exists = stat(arg, &st) == 0;
+        if (strcmp(op, "-e") == 0) {
+            return exists;
+        } else if (strcmp(op, "-f") == 0) {
+            return exists && S_ISREG(st.st_mode);
+        } else if (strcmp(op, "-d") == 0) {
+            return exists && S_ISDIR(st.st_mode);
+        } else if (strcmp(op, "-s") == 0) {
+            return exists && st.st_size > 0;
+        }
+        fprintf(stderr, "test: %s: unary operator expected\n", op);
+        return -1;
+    }
+    if (argc == 3) {
+        const char *a = argv[0], *op = argv[1], *b = argv[2];
+        if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+            return strcmp(a, b) == 0;
+        } else if (strcmp(op, "!=") == 0) {
+            return strcmp(a, b) != 0;
+        }
+        static const char *const ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+        for (int k = 0; k < 6; k++) {
+            long x, y;
+            if (strcmp(op, ops[k]) != 0) {
+                continue;
+            }
+            if (!parse_int(a, &x) || !parse_int(b, &y)) {
+                return -1;
+            }
+            bool results[] = {x == y, x != y, x < y, x <= y, x > y, x >= y};
+            return results[k];
+        }
+        fprintf(stderr, "test: %s: binary operator expected\n", op);
+        return -1;
+    }
+    fprintf(stderr, "test: too many arguments\n");
+    return -1;
+}
+
+int cmd_test(struct tokens *tokens) {
+    size_t argc = tokens_get_length(tokens) - 1;
+    char *argv[argc + 1];
+    for (size_t i = 0; i <= argc; i++) {
+        argv[i] = tokens_get_token(tokens, i + 1);
+    }
+    if (strcmp(tokens_get_token(tokens, 0), "[") == 0) {
+        if (argc == 0 || strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ]\n");
+            return BUILTIN_SYNTAX_ERROR;
+        }
+        argc--;
+    }
+    int result = evaluate(argc, argv);
+    return (result == 1) ? 1 : (result == 0) ? -1 : BUILTIN_SYNTAX_ERROR;
+}
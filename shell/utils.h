@@ -0,0 +1,31 @@
+#ifndef UTILS_H_
+#define UTILS_H_
+
+#include "tokenizer.h"
+
+/* Built-in versions of small utilities, so loops in scripts don't pay a
+ * process launch per call. Like the other built-ins they return 1 for
+ * success and -1 for failure. */
+
+/* What a built-in returns for a usage or syntax error (exit status 2), when
+ * that has to be told apart from plain failure. */
+#define BUILTIN_SYNTAX_ERROR (-2)
+
+/* echo [-n] words... */
+int cmd_echo(struct tokens *tokens);
+
+/* cat [file...], reading stdin for no file or "-". */
+int cmd_cat(struct tokens *tokens);
+
+/* test expression, and [ expression ]. A malformed expression (such as a
+ * missing ] or an unknown operator) is BUILTIN_SYNTAX_ERROR, not false. */
+int cmd_test(struct tokens *tokens);
+
+/* tee [-a] [file...]: stdin to stdout and every file, moving the data
+ * between pipes and files with tee(2)/splice(2) when it can. */
+int cmd_tee(struct tokens *tokens);
+
+int cmd_true(struct tokens *tokens);
+int cmd_false(struct tokens *tokens);
+
+#endif
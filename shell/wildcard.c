@@ -0,0 +1,398 @@
+#define _GNU_SOURCE
+
+#include "wildcard.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//globbing: "dir/*.txt", "src/[a-c]?/*.c"
+//plan:
+    //split the pattern at '/'; components without wildcards are just appended
+    //a wildcard component is compiled ONCE into a small program (char / any /
+    //star / class-bitmap ops) and run against every name in the directory
+    //directories are read with raw getdents64 into one buffer, sorted once and
+    //kept for the rest of the command line (the cache), so "a/* a/*.txt" or
+    //"*/x/*" never lists the same directory twice
+    //matching is the usual two-pointer scan that backtracks only to the last
+    //star, so it's linear in the name for patterns like *.txt
+
+#define NBUCKETS 64
+#define READ_SIZE (256 * 1024)
+
+/* The raw getdents64 record. */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* A name in a directory, with its d_type (DT_UNKNOWN on some filesystems). */
+struct entry {
+    const char *name;
+    unsigned char type;
+};
+
+/* One directory: its names back to back in NAMES, and ENTRIES pointing at
+ * them in sorted order. */
+struct listing {
+    char *path;
+    char *names;
+    struct entry *entries;
+    size_t count;
+    struct listing *next;
+};
+
+struct wildcard_cache {
+    struct listing *buckets[NBUCKETS];
+    char *buffer; //getdents64 buffer, shared by every read
+};
+
+enum op_kind { OP_CHAR, OP_ANY, OP_STAR, OP_CLASS };
+
+struct op {
+    enum op_kind kind;
+    unsigned char c;
+    uint64_t class[4]; //bitmap of the 256 bytes a [...] accepts
+};
+
+bool wildcard_special(char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+struct wildcard_cache *wildcard_cache_new(void) {
+    return calloc(1, sizeof(struct wildcard_cache));
+}
+
+void wildcard_cache_free(struct wildcard_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    for (int b = 0; b < NBUCKETS; b++) {
+        while (cache->buckets[b] != NULL) {
+            struct listing *l = cache->buckets[b];
+            cache->buckets[b] = l->next;
+            free(l->path);
+            free(l->names);
+            free(l->entries);
+            free(l);
+        }
+    }
+    free(cache->buffer);
+    free(cache);
+}
+
+static unsigned hash_path(const char *path) {
+    unsigned h = 5381; //djb2, like path_hash.c
+    while (*path != '\0') {
+        h = h * 33 + (unsigned char) *path++;
+    }
+    return h % NBUCKETS;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const struct entry *) a)->name, ((const struct entry *) b)->name);
+}
+
+/* Reads DIR with getdents64 (or returns the cached listing). NULL if it
+ * can't be read. */
+static struct listing *list_dir(struct wildcard_cache *cache, const char *dir) {
+    unsigned b = hash_path(dir);
+    for (struct listing *l = cache->buckets[b]; l != NULL; l = l->next) {
+        if (strcmp(l->path, dir) == 0) {
+            return l;
+        }
+    }
+    if (cache->buffer == NULL && (cache->buffer = malloc(READ_SIZE)) == NULL) {
+        return NULL;
+    }
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct listing *l = calloc(1, sizeof(struct listing));
+    unsigned char *types = NULL; //in read order, until the names stop moving
+    size_t length = 0, capacity = 0, types_capacity = 0;
+    long n;
+    while (l != NULL && (n = syscall(SYS_getdents64, fd, cache->buffer, READ_SIZE)) > 0) {
+        for (long off = 0; off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *) (cache->buffer + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue; //never . or ..
+            }
+            size_t len = strlen(name) + 1;
+            if (length + len > capacity) {
+                capacity = 2 * (length + len) + 4096;
+                char *grown = realloc(l->names, capacity);
+                if (grown == NULL) {
+                    goto fail;
+                }
+                l->names = grown;
+            }
+            if (l->count == types_capacity) {
+                types_capacity = 2 * types_capacity + 256;
+                unsigned char *grown = realloc(types, types_capacity);
+                if (grown == NULL) {
+                    goto fail;
+                }
+                types = grown;
+            }
+            memcpy(l->names + length, name, len);
+            length += len;
+            types[l->count++] = d->d_type;
+        }
+    }
+    if (l == NULL || (l->path = strdup(dir)) == NULL ||
+        (l->entries = malloc((l->count + 1) * sizeof(struct entry))) == NULL) {
+        goto fail;
+    }
+    close(fd);
+    const char *p = l->names;
+    for (size_t i = 0; i < l->count; i++) {
+        l->entries[i].name = p;
+        l->entries[i].type = types[i];
+        p += strlen(p) + 1;
+    }
+    free(types);
+    qsort(l->entries, l->count, sizeof(struct entry), compare_entries);
+    l->next = cache->buckets[b];
+    cache->buckets[b] = l;
+    return l;
+
+fail:
+    close(fd);
+    free(types);
+    if (l != NULL) {
+        free(l->path);
+        free(l->names);
+        free(l->entries);
+        free(l);
+    }
+    return NULL;
+}
+
+/* Compiles one path component (LEN bytes of PAT) into OPS, which has room for
+ * LEN ops. Returns the number of ops; *WILD says whether any aren't plain
+ * characters. */
+static size_t compile(const char *pat, size_t len, struct op *ops, bool *wild) {
+    size_t n = 0;
+    *wild = false;
+    for (size_t i = 0; i < len; i++) {
+        struct op *op = &ops[n];
+        memset(op, 0, sizeof(*op));
+        char c = pat[i];
+        if (c == '\\' && i + 1 < len) {
+            op->kind = OP_CHAR;
+            op->c = pat[++i];
+        } else if (c == '*') {
+            *wild = true;
+            if (n > 0 && ops[n - 1].kind == OP_STAR) {
+                continue; //** is the same as *
+            }
+            op->kind = OP_STAR;
+        } else if (c == '?') {
+            *wild = true;
+            op->kind = OP_ANY;
+        } else if (c == '[') {
+            //[abc] [a-z] [!x] [^x]; a ] right after [ (or [!) is a member
+            size_t j = i + 1;
+            bool negate = j < len && (pat[j] == '!' || pat[j] == '^');
+            j += negate;
+            size_t start = j;
+            while (j < len && (pat[j] != ']' || j == start)) {
+                j += (pat[j] == '\\' && j + 1 < len) ? 2 : 1;
+            }
+            if (j >= len) { //no closing ]: it's just a [
+                op->kind = OP_CHAR;
+                op->c = c;
+                n++;
+                continue;
+            }
+            *wild = true;
+            op->kind = OP_CLASS;
+            for (size_t k = start; k < j; k++) {
+                unsigned char lo = pat[k] == '\\' && k + 1 < j ? pat[++k] : pat[k];
+                unsigned char hi = lo;
+                if (k + 2 < j && pat[k + 1] == '-') {
+                    hi = (pat[k + 2] == '\\' && k + 3 < j) ? pat[k + 3] : pat[k + 2];
+                    k += (pat[k + 2] == '\\' && k + 3 < j) ? 3 : 2;
+                }
+                for (unsigned x = lo; x <= hi; x++) {
+                    op->class[x >> 6] |= 1ULL << (x & 63);
+                }
+            }
+            if (negate) {
+                for (int w = 0; w < 4; w++) {
+                    op->class[w] = ~op->class[w];
+                }
+            }
+            i = j;
+        } else {
+            op->kind = OP_CHAR;
+            op->c = c;
+        }
+        n++;
+    }
+    return n;
+}
+
+static bool op_matches(const struct op *op, unsigned char c) {
+    switch (op->kind) {
+    case OP_CHAR:
+        return op->c == c;
+    case OP_ANY:
+        return true;
+    case OP_CLASS:
+        return (op->class[c >> 6] >> (c & 63)) & 1;
+    default:
+        return false;
+    }
+}
+
+static bool match(const struct op *ops, size_t n, const char *name) {
+    if (name[0] == '.' && (n == 0 || ops[0].kind != OP_CHAR || ops[0].c != '.')) {
+        return false; //dot-files need the . spelled out
+    }
+    size_t p = 0, star = SIZE_MAX;
+    const char *s = name, *mark = NULL;
+    while (*s != '\0') {
+        if (p < n && ops[p].kind == OP_STAR) {
+            star = p++;
+            mark = s;
+        } else if (p < n && op_matches(&ops[p], (unsigned char) *s)) {
+            p++;
+            s++;
+        } else if (star != SIZE_MAX) { //let the last * eat one more character
+            p = star + 1;
+            s = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < n && ops[p].kind == OP_STAR) {
+        p++;
+    }
+    return p == n;
+}
+
+static int add_match(struct wildcard_matches *out, const char *path, size_t len) {
+    if (out->length + len + 1 > out->capacity) {
+        size_t capacity = 2 * (out->length + len + 1) + 4096;
+        char *grown = realloc(out->text, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        out->text = grown;
+        out->capacity = capacity;
+    }
+    memcpy(out->text + out->length, path, len);
+    out->text[out->length + len] = '\0';
+    out->length += len + 1;
+    out->count++;
+    return 0;
+}
+
+static bool is_dir(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* Expands the components of PATTERN from REST on, with PATH[0..LEN) the
+ * directory matched so far ("" = the current one). VERIFY = a literal
+ * component was appended without reading its directory, so the result still
+ * has to be checked. */
+static int expand(struct wildcard_cache *cache, const char *rest, char *path, size_t len,
+                  bool verify, struct wildcard_matches *out) {
+    while (*rest == '/') {
+        rest++;
+    }
+    if (*rest == '\0') {
+        struct stat st;
+        if (verify && lstat(path, &st) != 0) {
+            return 0;
+        }
+        return add_match(out, path, len);
+    }
+    size_t comp_len = strcspn(rest, "/");
+    const char *next = rest + comp_len;
+    bool last = *next == '\0';
+    bool dir_only = !last && next[strspn(next, "/")] == '\0'; //"pattern/" wants dirs
+    //on the heap: lines have no length limit, so neither does a component
+    struct op *ops = malloc((comp_len + 1) * sizeof(struct op));
+    if (ops == NULL) {
+        return -1;
+    }
+    bool wild;
+    size_t nops = compile(rest, comp_len, ops, &wild);
+    int rc = 0;
+
+    if (!wild) { //append it (unquoted) without looking at the directory
+        if (len + comp_len + 2 < PATH_MAX) {
+            for (size_t i = 0; i < nops; i++) {
+                path[len++] = ops[i].c;
+            }
+            if (!last) {
+                path[len++] = '/';
+            }
+            path[len] = '\0';
+            rc = expand(cache, next, path, len, true, out);
+        }
+        free(ops);
+        return rc;
+    }
+
+    struct listing *l = list_dir(cache, len == 0 ? "." : path);
+    for (size_t i = 0; l != NULL && i < l->count && rc == 0; i++) {
+        const char *name = l->entries[i].name;
+        if (!match(ops, nops, name)) {
+            continue;
+        }
+        size_t name_len = strlen(name);
+        if (len + name_len + 2 >= PATH_MAX) {
+            continue;
+        }
+        memcpy(path + len, name, name_len + 1);
+        size_t end = len + name_len;
+        if (!last) {
+            unsigned char type = l->entries[i].type;
+            if (type != DT_DIR && (type != DT_UNKNOWN && type != DT_LNK)) {
+                continue;
+            }
+            if (type != DT_DIR && !is_dir(path)) {
+                continue;
+            }
+            path[end++] = '/';
+            path[end] = '\0';
+            if (dir_only) { //"*/": the directory itself, with its slash
+                rc = add_match(out, path, end);
+                continue;
+            }
+        }
+        rc = expand(cache, next, path, end, false, out);
+    }
+    path[len] = '\0';
+    free(ops);
+    return rc;
+}
+
+int wildcard_expand(struct wildcard_cache *cache, const char *pattern,
+                    struct wildcard_matches *out) {
+    char path[PATH_MAX];
+    size_t len = 0;
+    if (pattern[0] == '/') {
+        path[len++] = '/';
+    }
+    path[len] = '\0';
+    return expand(cache, pattern, path, len, false, out);
+}
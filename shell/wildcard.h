@@ -0,0 +1,31 @@
+#ifndef WILDCARD_H_
+#define WILDCARD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Directory listings already read, so one command line never reads a
+ * directory twice. */
+struct wildcard_cache;
+
+struct wildcard_cache *wildcard_cache_new(void);
+void wildcard_cache_free(struct wildcard_cache *cache);
+
+/* Whether C is special in a pattern: * ? [ (and \, which quotes the next). */
+bool wildcard_special(char c);
+
+/* Paths a pattern expanded to: COUNT NUL-terminated strings, one after
+ * another in TEXT, in sorted order. */
+struct wildcard_matches {
+    char *text;
+    size_t length, capacity;
+    size_t count;
+};
+
+/* Adds every existing path PATTERN matches to OUT (* ? [...] in any
+ * component; \ quotes the next character; dot-files only match a leading
+ * '.'). Returns 0, or -1 if out of memory. */
+int wildcard_expand(struct wildcard_cache *cache, const char *pattern,
+                    struct wildcard_matches *out);
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * dTLB benchmark for the pwords word table.
+ *
+ * Builds a table of NWORDS random words once per allocation mode, then times
+ * NPROBES random find_word calls and counts the dTLB load misses they cause
+ * (through perf_event_open; reported as "n/a" where counters are not
+ * available). Modes:
+ *
+ *   heap      malloc'd entries and words, as without --pages
+ *   small     arena of ordinary pages
+ *   thp       arena advised to use transparent huge pages
+ *   hugetlb   arena from the hugetlbfs pool (falls back to thp)
+ *
+ * usage: bench_tlb [NWORDS [NPROBES]]
+ */
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wc_arena.h"
+#include "word_count.h"
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t xorshift(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Opens a counter for this thread's user-space dTLB read misses, or -1. */
+static int open_dtlb_counter(void) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* AnonHugePages of this process, in KiB. */
+static long anon_huge_kb(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long kb = 0;
+
+    if (f == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static void run(const char *mode, char **keys, size_t nwords, size_t nprobes) {
+    word_count_list_t table;
+    wc_arena_t arena;
+    wc_pages_t pages;
+    long huge_before = anon_huge_kb();
+    int fd = open_dtlb_counter();
+    uint64_t misses = 0, state = 88172645463325252ull, found = 0;
+    double t0, t_probe;
+
+    init_words(&table);
+    if (wc_pages_parse(mode, &pages)) {
+        wc_arena_init(&arena, pages);
+        words_use_arena(&table, &arena);
+    }
+    for (size_t i = 0; i < nwords; i++) {
+        char *word = strdup(keys[i]);
+        if (word == NULL || add_word(&table, word) == NULL) {
+            fprintf(stderr, "%s: out of memory after %zu words\n", mode, i);
+            exit(1);
+        }
+    }
+
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    t0 = now();
+    for (size_t i = 0; i < nprobes; i++) {
+        found += find_word(&table, keys[xorshift(&state) % nwords]) != NULL;
+    }
+    t_probe = now() - t0;
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses)) {
+            misses = 0;
+        }
+        close(fd);
+    }
+
+    printf("%-8s %9zu words %9zu hits %8.1f ns/probe ", mode, nwords,
+           (size_t) found, t_probe / nprobes * 1e9);
+    if (fd >= 0) {
+        printf("%8.3f dTLB misses/probe ", (double) misses / nprobes);
+    } else {
+        printf("%8s dTLB misses/probe ", "n/a");
+    }
+    printf("%8ld KiB huge\n", anon_huge_kb() - huge_before);
+    /* The table is dropped rather than freed; each mode starts from scratch. */
+}
+
+int main(int argc, char *argv[]) {
+    size_t nwords = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t nprobes = (argc > 2) ? strtoul(argv[2], NULL, 10) : 2000000;
+    static const char *const modes[] = {"heap", "small", "thp", "hugetlb"};
+    uint64_t state = 2463534242ull;
+    char **keys;
+
+    if (nwords == 0 || (keys = malloc(nwords * sizeof(char *))) == NULL) {
+        fprintf(stderr, "usage: %s [NWORDS [NPROBES]]\n", argv[0]);
+        return 1;
+    }
+    /* Random lowercase words of 6..13 letters; duplicates are harmless. */
+    for (size_t i = 0; i < nwords; i++) {
+        char buf[16];
+        int len = 6 + xorshift(&state) % 8;
+        for (int j = 0; j < len; j++) {
+            buf[j] = 'a' + xorshift(&state) % 26;
+        }
+        buf[len] = '\0';
+        keys[i] = strdup(buf);
+    }
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        run(modes[m], keys, nwords, nprobes);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Microbenchmark for the word_count representations.
+ *
+ * Tokenizes the input files up front, then times add_word over every token
+ * and wordcount_sort by word, and reports the heap held by the finished
+ * table. Built once per representation (see the bench target in Makefile):
+ *
+ *   bench_list   dedicated singly linked list   (word_count.c)
+ *   bench_plist  Pintos list                    (word_count_l.c)
+ *   bench_art    adaptive radix tree            (word_count_art.c)
+ */
+
+#include <ctype.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "word_count.h"
+#include "word_helpers.h"
+
+#if defined(ART_TRIE)
+#define VARIANT "art"
+#elif defined(PINTOS_LIST)
+#define VARIANT "pintos list"
+#else
+#define VARIANT "list"
+#endif
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t heap_in_use(void) {
+    return mallinfo2().uordblks;
+}
+
+/* Appends the words of INFILE (as count_words sees them) to *TOKENS. */
+static void tokenize(FILE *infile, char ***tokens, size_t *n, size_t *cap) {
+    char buf[4096];
+    size_t len = 0;
+    int ch;
+
+    do {
+        ch = fgetc(infile);
+        if (isalpha(ch) && len < sizeof(buf) - 1) {
+            buf[len++] = tolower(ch);
+            continue;
+        }
+        if (len > 1) {
+            if (*n == *cap) {
+                *cap = *cap ? *cap * 2 : 1024;
+                *tokens = realloc(*tokens, *cap * sizeof(char *));
+            }
+            buf[len] = '\0';
+            (*tokens)[(*n)++] = strdup(buf);
+        }
+        len = 0;
+    } while (ch != EOF);
+}
+
+int main(int argc, char *argv[]) {
+    word_count_list_t word_counts;
+    char **tokens = NULL;
+    size_t ntokens = 0, cap = 0, base, table;
+    double t0, t_insert, t_sort;
+
+    if (argc <= 1) {
+        fprintf(stderr, "usage: %s FILE...\n", argv[0]);
+        return 1;
+    }
+
+    base = heap_in_use();
+    for (int i = 1; i < argc; i++) {
+        FILE *infile = fopen(argv[i], "r");
+        if (infile == NULL) {
+            perror("fopen");
+            return 1;
+        }
+        tokenize(infile, &tokens, &ntokens, &cap);
+        fclose(infile);
+    }
+
+    init_words(&word_counts);
+    t0 = now();
+    for (size_t i = 0; i < ntokens; i++) {
+        add_word(&word_counts, tokens[i]);
+    }
+    t_insert = now() - t0;
+    free(tokens);
+    table = heap_in_use() - base;
+
+    t0 = now();
+    wordcount_sort(&word_counts, less_word);
+    t_sort = now() - t0;
+
+    printf("%-12s %8zu tokens %7zu words %9.3f ms insert %8.2f Minserts/s "
+           "%8.3f ms sort %9zu bytes %6.1f bytes/word\n",
+           VARIANT, ntokens, len_words(&word_counts), t_insert * 1e3,
+           ntokens / t_insert / 1e6, t_sort * 1e3, table,
+           (double) table / len_words(&word_counts));
+    return 0;
+}
@@ -22,122 +22,237 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "ngram.h"
+#include "shm_table.h"
 #include "word_count.h"
 #include "word_helpers.h"
 
-//multiple processes = send results via pipes (bc processes dont share memory)
+//multiple processes = processes dont share memory, so each child builds its
+//table in a shared memory region (memfd) instead of sending it down a pipe
 //need to:
-    //make pipe for every child and fork
-    //write child and parent processes
-    //combine
+    //make a memfd for a child and fork (one child per CPU at a time)
+    //child counts its file straight into the shared table
+    //parent waits for any child, maps its region, merges it, unmaps it,
+    //closes the memfd and starts the next file in its place
 
 //idea:
 /*
-parent --> fork child1 -> open/read file1 -> outputs wordcount to pipe & close file
-       --> fork child1 -> open/read file2 -> outputs wordcount to pipe & close file
-       --> fork child1 -> open/read file3 -> outputs wordcount to pipe & close file
+parent --> memfd1, fork child1 -> open/read file1 -> counts into memfd1 & exit
+       --> memfd2, fork child2 -> open/read file2 -> counts into memfd2 & exit
        --> etc.. (for however many files)
 
-    --> then parent takes all the children's outputs & merges pipes into one final result
+    --> then parent waits for whichever child is done, maps its memfd and
+        adds every entry to the final result (no text to re-parse), which is
+        hash-indexed so each entry is one lookup
 */
 
+static int ngram_n; //0 unless -n was given
+static bool merge_failed; //set when an entry couldn't be added in merge_shm
+static bool shm_failed;   //the child's: set when its shared table couldn't grow
+
+static bool add_to_shm(char *word, void *table) {
+    bool ok = shm_table_add(table, word, strlen(word), 1);
+    free(word);
+    shm_failed = shm_failed || !ok;
+    return ok;
+}
+
+//-n mode: the child's n-grams go into the shared table as "w1 w2 ..." text
+static void gram_to_shm(const char *text, int count, void *table) {
+    if (!shm_failed && !shm_table_add(table, text, strlen(text), count)) {
+        shm_failed = true; //the rest would be missing too
+    }
+}
+
+static void merge_gram(const char *text, int count, void *grams) {
+    if (!ngram_add_text(grams, text, count)) {
+        merge_failed = true;
+    }
+}
+
+static void merge_entry(const char *word, int count, void *wclist) {
+    //the word lives in the child's mapping, so only a new word gets copied
+    word_count_t *wc = find_word(wclist, (char *) word);
+    char *copy;
+    if (wc != NULL) {
+        wc->count += count;
+    } else if ((copy = strdup(word)) == NULL) {
+        perror("strdup");
+        merge_failed = true;
+    } else if (add_word_with_count(wclist, copy, count) == NULL) {
+        free(copy); //add_word_with_count keeps the copy on success
+        merge_failed = true;
+    }
+}
+
+/*
+ * Child side: count FILENAME into a fresh shared table in FD.
+ */
+static void count_into_shm(const char *filename, int fd) {
+    shm_table_t table;
+    FILE *file;
+
+    if (!shm_table_create(&table, fd)) {
+        exit(1);
+    }
+    if ((file = fopen(filename, "r")) == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    if (ngram_n > 0) {
+        ngram_table_t grams;
+        if (!ngram_init(&grams, ngram_n)) {
+            exit(1);
+        }
+        count_ngrams(&grams, file);
+        ngram_for_each(&grams, gram_to_shm, &table);
+    } else {
+        for_each_word(file, add_to_shm, &table);
+    }
+    fclose(file);
+    shm_table_unmap(&table);
+    exit(shm_failed ? 1 : 0); //a partial table must not be merged as if whole
+}
+
+/*
+ * Parent side: merge the table a child left in FD into WCLIST, or into GRAMS
+ * in -n mode. Returns false if any of it couldn't be merged.
+ */
+static bool merge_shm(word_count_list_t *wclist, ngram_table_t *grams, int fd) {
+    shm_table_t table;
+
+    if (!shm_table_map(&table, fd)) {
+        return false;
+    }
+    merge_failed = false;
+    if (ngram_n > 0) {
+        shm_table_for_each(&table, merge_gram, grams);
+    } else {
+        shm_table_for_each(&table, merge_entry, wclist);
+    }
+    shm_table_unmap(&table);
+    return !merge_failed;
+}
+
 /*
- * Read stream of counts and accumulate globally.
+ * Parent side: make FILENAME's memfd and fork its child. Returns false (after
+ * saying why) if either fails.
  */
-void merge_counts(word_count_list_t *wclist, FILE *count_stream) {
-    char *word;
-    int count;
-    int rv;
-    while ((rv = fscanf(count_stream, "%8d\t%ms\n", &count, &word)) == 2) {
-        add_word_with_count(wclist, word, count);
+static bool start_child(const char *filename, pid_t *pid, int *fd) {
+    //one shared memory object per child; the parent keeps its fd
+    *fd = memfd_create("fwords", MFD_CLOEXEC);
+    if (*fd == -1) {
+        perror("memfd_create");
+        return false;
     }
-    if ((rv == EOF) && (feof(count_stream) == 0)) {
-        perror("could not read counts");
-    } else if (rv != EOF) {
-        fprintf(stderr, "read ill-formed count (matched %d)\n", rv);
+    *pid = fork();
+    if (*pid == -1) {
+        perror("fork");
+        close(*fd);
+        return false;
     }
+    if (*pid == 0) { //child
+        count_into_shm(filename, *fd); //never returns
+    }
+    return true;
 }
 
 /*
  * main - handle command line, spawning one process per file.
+ *
+ * With -n N, runs of N consecutive words are counted instead of single words.
  */
 int main(int argc, char *argv[]) {
     /* Create the empty data structure. */
     word_count_list_t word_counts;
     init_words(&word_counts);
+    ngram_table_t grams;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        if ((ngram_n = ngram_parse_n(argv[2])) == 0) {
+            fprintf(stderr, "-n: expected 1..%d\n", NGRAM_MAX);
+            return 1;
+        }
+        if (!ngram_init(&grams, ngram_n)) {
+            return 1;
+        }
+        argv += 2;
+        argc -= 2;
+    }
 
     if (argc <= 1) {
         /* Process stdin in a single process. */
-        count_words(&word_counts, stdin);
+        if (ngram_n > 0) {
+            count_ngrams(&grams, stdin);
+        } else {
+            count_words(&word_counts, stdin);
+        }
     } else {
-        for (int i = 1; i < argc; i++) { //for every file argument
-            //creates a pipe where pipefd[0] is the read end & pipefd[1] is the write end.
-            //use to send wordcounts from the child to parent.
-            int pipefd[2];
-            if (pipe(pipefd) == -1) {
-                perror("pipe");
-                exit(1);
+        int num_files = argc - 1;
+        long max_children = sysconf(_SC_NPROCESSORS_ONLN);
+        pid_t pids[num_files];
+        int fds[num_files];
+        int next = 0, running = 0;
+
+        if (max_children < 1) {
+            max_children = 1;
+        }
+        //at most one child (and one open memfd) per CPU, whatever the file
+        //count, so lots of files can't run the parent out of descriptors
+        while (next < num_files || running > 0) {
+            while (next < num_files && running < max_children) {
+                if (start_child(argv[next + 1], &pids[next], &fds[next])) {
+                    running++;
+                } else {
+                    pids[next] = -1;
+                    fprintf(stderr, "could not count %s\n", argv[next + 1]);
+                }
+                next++;
+            }
+            if (running == 0) {
+                break;
             }
 
-            pid_t pid = fork();
+            int status, i = 0;
+            pid_t pid = wait(&status); //whichever child is done first
             if (pid == -1) {
-                perror("fork");
-                exit(1);
+                perror("wait");
+                break;
             }
-
-            //if pid == 0, then child process; if pid > 0, then parent process
-            if (pid == 0) { //child
-                close(pipefd[0]); //child doesn't read, so close read end of pipe
-
-                //open write end to output into a FILE*
-                FILE *out = fdopen(pipefd[1], "w");
-                if (!out) {
-                    perror("fdopen (child)");
-                    exit(1);
-                }
-
-                word_count_list_t local_counts;
-                init_words(&local_counts);
-
-                FILE *file = fopen(argv[i], "r");
-                if (!file) {
-                    perror("fopen");
-                    exit(1);
-                }
-
-                count_words(&local_counts, file);
-                fclose(file);
-                wordcount_sort(&local_counts, less_count);
-                fprint_words(&local_counts, out); //print wordcounts to output (pipe write end)
-                fclose(out); //!!close the write end of the pipe
-                exit(0); //exit child process
-
-            } else { //parent process
-                close(pipefd[1]); //parent doesnt write, so close pipe's write end
-                //kernel signals EOF only once all write ends are closed
-
-                //convert pipefd[0] into a FILE* stream (so in merge_counts you can use fscanf)
-                FILE *in = fdopen(pipefd[0], "r");
-                if (!in) {
-                    perror("fdopen (parent)");
-                    exit(1);
-                }
-
-                merge_counts(&word_counts, in);
-                fclose(in);
+            while (i < next && pids[i] != pid) {
+                i++;
             }
+            if (i == next) { //not one of ours
+                continue;
+            }
+            running--;
+            //a crashed child only loses its own file
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+                !merge_shm(&word_counts, &grams, fds[i])) {
+                fprintf(stderr, "could not count %s\n", argv[i + 1]);
+            }
+            close(fds[i]);
         }
     }
 
     /* Output final result of all process' work. */
+    if (ngram_n > 0) {
+        ngram_print(&grams, stdout, false);
+        ngram_destroy(&grams);
+        return 0;
+    }
     wordcount_sort(&word_counts, less_count);
     fprint_words(&word_counts, stdout);
     return 0;
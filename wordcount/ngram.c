@@ -0,0 +1,371 @@
+/*
+ * Implementation of the ngram interface.
+ *
+ * Both the dictionary and the n-gram table are open-addressed with linear
+ * probing and keep each key's full hash, so growing never rehashes strings
+ * and most probes are settled by comparing hashes alone.
+ */
+
+#include "ngram.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wc_writer.h"
+#include "word_helpers.h"
+
+#define NGRAM_BASE 0x100000001b3ull
+#define INITIAL_SLOTS 1024
+
+static uint64_t hash_word(const char *word, size_t len) {
+    uint64_t h = 14695981039346656037ull; /* FNV-1a */
+    for (const char *end = word + len; word < end; word++) {
+        h ^= (unsigned char) *word;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* Spreads a word ID over 64 bits before it enters the rolling hash. */
+static uint64_t id_term(uint32_t id) {
+    return (id + 1ull) * 0x9e3779b97f4a7c15ull;
+}
+
+/* Final mix so that slot indices use every bit of a hash. */
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 31;
+    h *= 0x7fb5d329728ea185ull;
+    h ^= h >> 27;
+    return h;
+}
+
+bool ngram_init(ngram_table_t *table, int n) {
+    memset(table, 0, sizeof(*table));
+    if (n < 1 || n > NGRAM_MAX) {
+        return false;
+    }
+    table->n = n;
+    table->base_pow = 1;
+    for (int i = 1; i < n; i++) {
+        table->base_pow *= NGRAM_BASE;
+    }
+    table->word_slots = calloc(INITIAL_SLOTS, sizeof(uint32_t));
+    table->gram_slots = calloc(INITIAL_SLOTS, sizeof(uint32_t));
+    if (table->word_slots == NULL || table->gram_slots == NULL) {
+        perror("calloc");
+        ngram_destroy(table);
+        return false;
+    }
+    table->word_mask = INITIAL_SLOTS - 1;
+    table->gram_mask = INITIAL_SLOTS - 1;
+    return true;
+}
+
+void ngram_destroy(ngram_table_t *table) {
+    for (uint32_t i = 0; i < table->nwords; i++) {
+        free(table->words[i]);
+    }
+    free(table->words);
+    free(table->word_hashes);
+    free(table->word_slots);
+    free(table->gram_ids);
+    free(table->gram_counts);
+    free(table->gram_hashes);
+    free(table->gram_slots);
+    memset(table, 0, sizeof(*table));
+}
+
+/* Rebuilds an index of MASK + 1 slots twice as large from stored hashes. */
+static bool grow_slots(uint32_t **slots, uint32_t *mask, const uint64_t *hashes,
+                       uint32_t count) {
+    uint32_t new_mask = *mask * 2 + 1;
+    uint32_t *new_slots = calloc(new_mask + 1, sizeof(uint32_t));
+
+    if (new_slots == NULL) {
+        perror("calloc");
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t s = mix(hashes[i]) & new_mask;
+        while (new_slots[s] != 0) {
+            s = (s + 1) & new_mask;
+        }
+        new_slots[s] = i + 1;
+    }
+    free(*slots);
+    *slots = new_slots;
+    *mask = new_mask;
+    return true;
+}
+
+/* Returns the ID of the LEN-byte WORD (which needn't be NUL-terminated),
+ * adding it to the dictionary if needed, or UINT32_MAX. */
+static uint32_t intern(ngram_table_t *table, const char *word, size_t len) {
+    uint64_t h = hash_word(word, len);
+    uint32_t s = mix(h) & table->word_mask, id;
+
+    for (; table->word_slots[s] != 0; s = (s + 1) & table->word_mask) {
+        id = table->word_slots[s] - 1;
+        if (table->word_hashes[id] == h && strncmp(table->words[id], word, len) == 0 &&
+            table->words[id][len] == '\0') {
+            return id;
+        }
+    }
+
+    if (table->nwords == table->words_cap) {
+        uint32_t cap = table->words_cap ? table->words_cap * 2 : 1024;
+        char **words = realloc(table->words, cap * sizeof(char *));
+        uint64_t *hashes;
+        if (words == NULL) {
+            perror("realloc");
+            return UINT32_MAX;
+        }
+        table->words = words;
+        if ((hashes = realloc(table->word_hashes, cap * sizeof(uint64_t))) ==
+            NULL) {
+            perror("realloc");
+            return UINT32_MAX;
+        }
+        table->word_hashes = hashes;
+        table->words_cap = cap;
+    }
+    id = table->nwords;
+    if ((table->words[id] = strndup(word, len)) == NULL) {
+        perror("strndup");
+        return UINT32_MAX;
+    }
+    table->word_hashes[id] = h;
+    table->word_slots[s] = id + 1;
+    table->nwords++;
+    if (table->nwords * 2 > table->word_mask &&
+        !grow_slots(&table->word_slots, &table->word_mask, table->word_hashes,
+                    table->nwords)) {
+        return UINT32_MAX;
+    }
+    return id;
+}
+
+/* Hash of a whole n-gram; equals the rolling hash after its last word. */
+static uint64_t gram_hash(const uint32_t *ids, int n) {
+    uint64_t h = 0;
+    for (int i = 0; i < n; i++) {
+        h = h * NGRAM_BASE + id_term(ids[i]);
+    }
+    return h;
+}
+
+/* Adds COUNT to the n-gram IDS whose hash is H. */
+static bool add_gram(ngram_table_t *table, const uint32_t *ids, uint64_t h,
+                     int count) {
+    size_t n = table->n;
+    uint32_t s = mix(h) & table->gram_mask, e;
+
+    for (; table->gram_slots[s] != 0; s = (s + 1) & table->gram_mask) {
+        e = table->gram_slots[s] - 1;
+        if (table->gram_hashes[e] == h &&
+            memcmp(&table->gram_ids[e * n], ids, n * sizeof(uint32_t)) == 0) {
+            table->gram_counts[e] += count;
+            return true;
+        }
+    }
+
+    if (table->ngrams == table->grams_cap) {
+        uint32_t cap = table->grams_cap ? table->grams_cap * 2 : 1024;
+        uint32_t *gram_ids = realloc(table->gram_ids,
+                                     cap * n * sizeof(uint32_t));
+        int *counts;
+        uint64_t *hashes;
+        if (gram_ids == NULL) {
+            perror("realloc");
+            return false;
+        }
+        table->gram_ids = gram_ids;
+        if ((counts = realloc(table->gram_counts, cap * sizeof(int))) == NULL) {
+            perror("realloc");
+            return false;
+        }
+        table->gram_counts = counts;
+        if ((hashes = realloc(table->gram_hashes, cap * sizeof(uint64_t))) ==
+            NULL) {
+            perror("realloc");
+            return false;
+        }
+        table->gram_hashes = hashes;
+        table->grams_cap = cap;
+    }
+    e = table->ngrams++;
+    memcpy(&table->gram_ids[e * n], ids, n * sizeof(uint32_t));
+    table->gram_counts[e] = count;
+    table->gram_hashes[e] = h;
+    table->gram_slots[s] = e + 1;
+    if (table->ngrams * 2 > table->gram_mask) {
+        return grow_slots(&table->gram_slots, &table->gram_mask,
+                          table->gram_hashes, table->ngrams);
+    }
+    return true;
+}
+
+bool ngram_push(ngram_table_t *table, const char *word) {
+    uint32_t id = intern(table, word, strlen(word));
+
+    if (id == UINT32_MAX) {
+        return false;
+    }
+    if (table->filled == table->n) {
+        /* Slide: drop the oldest word's term before shifting in the new one. */
+        table->roll -= id_term(table->window[0]) * table->base_pow;
+        memmove(table->window, table->window + 1,
+                (table->n - 1) * sizeof(uint32_t));
+        table->filled--;
+    }
+    table->window[table->filled++] = id;
+    table->roll = table->roll * NGRAM_BASE + id_term(id);
+    if (table->filled < table->n) {
+        return true;
+    }
+    return add_gram(table, table->window, table->roll, 1);
+}
+
+void ngram_reset(ngram_table_t *table) {
+    table->filled = 0;
+    table->roll = 0;
+}
+
+static bool push_word(char *word, void *table) {
+    bool ok = ngram_push(table, word);
+    free(word);
+    return ok;
+}
+
+void count_ngrams(ngram_table_t *table, FILE *infile) {
+    ngram_reset(table);
+    for_each_word(infile, push_word, table);
+    ngram_reset(table);
+}
+
+void count_ngrams_in(ngram_table_t *table, const char *buf, size_t len) {
+    ngram_reset(table);
+    for_each_word_in(buf, len, push_word, table);
+    ngram_reset(table);
+}
+
+bool ngram_add_text(ngram_table_t *table, const char *text, int count) {
+    uint32_t ids[NGRAM_MAX];
+    int i = 0;
+
+    while (*text != '\0') {
+        size_t len = strcspn(text, " "); //interned straight from TEXT, any length
+        if (i == table->n || len == 0) {
+            return false;
+        }
+        if ((ids[i++] = intern(table, text, len)) == UINT32_MAX) {
+            return false;
+        }
+        text += len + (text[len] == ' ');
+    }
+    if (i != table->n) {
+        return false;
+    }
+    return add_gram(table, ids, gram_hash(ids, table->n), count);
+}
+
+bool ngram_merge(ngram_table_t *dst, const ngram_table_t *src) {
+    uint32_t *map = malloc((src->nwords + 1) * sizeof(uint32_t));
+    uint32_t ids[NGRAM_MAX];
+    bool ok = map != NULL && dst->n == src->n;
+
+    for (uint32_t i = 0; ok && i < src->nwords; i++) {
+        map[i] = intern(dst, src->words[i], strlen(src->words[i]));
+        ok = map[i] != UINT32_MAX;
+    }
+    for (uint32_t e = 0; ok && e < src->ngrams; e++) {
+        for (int k = 0; k < src->n; k++) {
+            ids[k] = map[src->gram_ids[e * src->n + k]];
+        }
+        ok = add_gram(dst, ids, gram_hash(ids, dst->n), src->gram_counts[e]);
+    }
+    free(map);
+    return ok;
+}
+
+/* Returns the malloc'd text of entry E. */
+static char *gram_text(const ngram_table_t *table, uint32_t e) {
+    const uint32_t *ids = &table->gram_ids[e * table->n];
+    size_t len = 0;
+    char *text, *p;
+
+    for (int k = 0; k < table->n; k++) {
+        len += strlen(table->words[ids[k]]) + 1;
+    }
+    if ((text = malloc(len)) == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    p = text;
+    for (int k = 0; k < table->n; k++) {
+        size_t wlen = strlen(table->words[ids[k]]);
+        memcpy(p, table->words[ids[k]], wlen);
+        p += wlen;
+        *p++ = ' ';
+    }
+    p[-1] = '\0';
+    return text;
+}
+
+void ngram_for_each(const ngram_table_t *table,
+                    void fn(const char *text, int count, void *aux),
+                    void *aux) {
+    for (uint32_t e = 0; e < table->ngrams; e++) {
+        char *text = gram_text(table, e);
+        if (text == NULL) {
+            return;
+        }
+        fn(text, table->gram_counts[e], aux);
+        free(text);
+    }
+}
+
+static int cmp_count(const void *a, const void *b) {
+    const wc_entry_t *x = a, *y = b;
+    if (x->count != y->count) {
+        return (x->count < y->count) ? -1 : 1;
+    }
+    return strcmp(x->word, y->word);
+}
+
+static int cmp_text(const void *a, const void *b) {
+    return strcmp(((const wc_entry_t *) a)->word,
+                  ((const wc_entry_t *) b)->word);
+}
+
+void ngram_print(const ngram_table_t *table, FILE *outfile, bool alphabetical) {
+    wc_entry_t *entries;
+    uint32_t n = 0;
+
+    if (table->ngrams == 0) {
+        return;
+    }
+    if ((entries = malloc(table->ngrams * sizeof(wc_entry_t))) == NULL) {
+        perror("malloc");
+        return;
+    }
+    for (; n < table->ngrams; n++) {
+        char *text = gram_text(table, n);
+        if (text == NULL) {
+            break;
+        }
+        entries[n] = (wc_entry_t) {table->gram_counts[n], text};
+    }
+    qsort(entries, n, sizeof(wc_entry_t), alphabetical ? cmp_text : cmp_count);
+    wc_write_entries(outfile, entries, n);
+    for (uint32_t i = 0; i < n; i++) {
+        free((char *) entries[i].word);
+    }
+    free(entries);
+}
+
+int ngram_parse_n(const char *arg) {
+    char *end;
+    long n = strtol(arg, &end, 10);
+    return (*arg != '\0' && *end == '\0' && n >= 1 && n <= NGRAM_MAX) ? n : 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * The ngram interface counts word n-grams in one pass.
+ *
+ * Words are interned to dense integer IDs and an n-gram is keyed by its N IDs,
+ * hashed with a rolling polynomial hash that is updated in O(1) as the window
+ * slides. The text of an n-gram is only built when the table is printed.
+ * Words are the ones count_words sees, so one-letter words are skipped and
+ * "-n 1" matches the plain word count.
+ */
+
+#ifndef NGRAM_H
+#define NGRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Largest N accepted. */
+#define NGRAM_MAX 16
+
+typedef struct ngram_table {
+    int n;
+
+    /* Word dictionary: id -> word, and an open-addressed word -> id index. */
+    char **words;
+    uint64_t *word_hashes;
+    uint32_t nwords;
+    uint32_t words_cap;
+    uint32_t *word_slots; /* id + 1, or 0 if empty. */
+    uint32_t word_mask;
+
+    /* N-grams: N ids, count and hash per entry, open-addressed by hash. */
+    uint32_t *gram_ids;
+    int *gram_counts;
+    uint64_t *gram_hashes;
+    uint32_t ngrams;
+    uint32_t grams_cap;
+    uint32_t *gram_slots; /* entry + 1, or 0 if empty. */
+    uint32_t gram_mask;
+
+    /* Sliding window over the current stream. */
+    uint32_t window[NGRAM_MAX];
+    int filled;
+    uint64_t roll;
+    uint64_t base_pow; /* NGRAM_BASE^(n-1), to drop the oldest word. */
+} ngram_table_t;
+
+/* Initializes an empty table of N-grams (1 <= N <= NGRAM_MAX). */
+bool ngram_init(ngram_table_t *table, int n);
+
+/* Frees everything TABLE owns. */
+void ngram_destroy(ngram_table_t *table);
+
+/* Feeds the next word of the current stream. Does not take ownership. */
+bool ngram_push(ngram_table_t *table, const char *word);
+
+/* Ends the current stream, so no n-gram spans it and the next one. */
+void ngram_reset(ngram_table_t *table);
+
+/* Reads all words from INFILE as one stream. */
+void count_ngrams(ngram_table_t *table, FILE *infile);
+
+/* Reads all words in the LEN bytes at BUF as one stream. */
+void count_ngrams_in(ngram_table_t *table, const char *buf, size_t len);
+
+/* Adds COUNT to the n-gram spelled TEXT (N words separated by spaces). */
+bool ngram_add_text(ngram_table_t *table, const char *text, int count);
+
+/* Adds every n-gram of SRC (same N) to DST, translating word IDs. */
+bool ngram_merge(ngram_table_t *dst, const ngram_table_t *src);
+
+/* Calls FN with the text and count of every n-gram, in no particular order. */
+void ngram_for_each(const ngram_table_t *table,
+                    void fn(const char *text, int count, void *aux),
+                    void *aux);
+
+/*
+ * Prints "%8d\t%s\n" lines sorted like less_count, or alphabetically if
+ * ALPHABETICAL is set.
+ */
+void ngram_print(const ngram_table_t *table, FILE *outfile, bool alphabetical);
+
+/* Parses the argument of a -n option. Returns 0 if it is not a valid N. */
+int ngram_parse_n(const char *arg);
+
+#endif /* NGRAM_H */
@@ -23,93 +23,468 @@
  */
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "ngram.h"
+#include "wc_arena.h"
+#include "wc_pin.h"
+#include "wc_stats.h"
 #include "word_count.h"
 #include "word_helpers.h"
 
 //need to:
     //spawn threads
-    //open and process each file in aseparate thread
-    //properly synchronize access to shared data structures when processing files
+    //split the files into chunks and count every chunk on some thread
+    //keep threads busy even when one file is much bigger than the others
 //should make:
+    //chunks:
+        //every file is mmapped and cut into ~CHUNK_SIZE pieces
+        //a cut is moved forward past the end of the current word, so no word
+        //is ever split between two chunks
+    //deques (one per worker):
+        //file i's chunks start on worker i % nworkers (= one thread per file)
+        //owner takes chunks from the front, in file order
+        //a worker with nothing left steals from the back of another's deque
     //struct:
-        //has name of file the thread is reading and pointer to shared list -->one per thread
+        //has the worker's own private list (and n-gram table for -n)
     //a function that each thread runs:
-        //open the file (w/ proper error if cant open)
-        //count the words (like in words.c)
-        //CLOSE the file
+        //count chunks into the private list until no deque has any left
+        //split the private list into nparts lists by hash(word)
+    //merging (so one core isn't stuck merging everything at the end):
+        //merger r takes part r from every worker --> no word is in two mergers
+        //each merger sorts its own part, then one k-way merge puts them in order
+    //placement (--pin, --pages):
+        //worker w and merger r are pinned to the CPU the policy gives index w/r
+        //with --pages each list gets an arena that its own thread touches
+        //first, so the kernel puts it on that thread's node
+
+#define CHUNK_SIZE (64 * 1024)
+
+typedef struct {
+    const char *data;
+    size_t len;
+} chunk_t;
 
 typedef struct {
-    const char *filename;
-    word_count_list_t *wclist;
+    pthread_mutex_t lock;
+    chunk_t *chunks;
+    size_t head, tail, cap; //chunks[head..tail) are still waiting
+} deque_t;
+
+typedef struct {
+    size_t id;
+    word_count_list_t wclist; //private, so adding never waits on another thread
+    struct list *parts;       //nparts lists, filled once counting is done
+    ngram_table_t grams;      //used instead of wclist in -n mode
+#ifdef WC_STATS
+    wc_thread_stats_t *stats; //so main can fill in idle time after the join
+#endif
 } threadStruct;
 
+typedef struct {
+    size_t index;
+    threadStruct *workers;
+    int num_workers;
+    word_count_list_t *part; //this merger's output
+} mergeStruct;
+
+static deque_t *deques;
+static size_t nworkers;
+static size_t nparts;
+static int ngram_n; //0 unless -n was given
+static wc_pin_t pin_policy = WC_PIN_NONE;
+static bool use_arenas;
+static wc_pages_t pages_kind;
+
+//name for --stats, with where the thread ended up
+static void attach_stats(const char *role, size_t index, int cpu) {
+    char name[48];
+    if (cpu >= 0) {
+        snprintf(name, sizeof(name), "%s %zu (cpu %d node %d)", role, index,
+                 cpu, wc_pin_node_of(cpu));
+    } else {
+        snprintf(name, sizeof(name), "%s %zu", role, index);
+    }
+    WC_STATS_ATTACH(strdup(name));
+}
+
+//only called before the workers start, so no locking
+static bool deque_push(deque_t *dq, chunk_t chunk) {
+    if (dq->tail == dq->cap) {
+        size_t cap = dq->cap ? dq->cap * 2 : 64;
+        chunk_t *chunks = realloc(dq->chunks, cap * sizeof(chunk_t));
+        if (chunks == NULL) {
+            perror("realloc");
+            return false;
+        }
+        dq->chunks = chunks;
+        dq->cap = cap;
+    }
+    dq->chunks[dq->tail++] = chunk;
+    return true;
+}
+
+//owner end
+static bool deque_pop(deque_t *dq, chunk_t *chunk) {
+    bool found = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        *chunk = dq->chunks[dq->head++];
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+//thief end: takes the chunk the owner would have reached last
+static bool deque_steal(deque_t *dq, chunk_t *chunk) {
+    bool found = false;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        *chunk = dq->chunks[--dq->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+//no chunks are added once workers start, so one empty pass means we're done
+static bool next_chunk(size_t id, chunk_t *chunk) {
+    if (deque_pop(&deques[id], chunk)) {
+        return true;
+    }
+    for (size_t k = 1; k < nworkers; k++) {
+        if (deque_steal(&deques[(id + k) % nworkers], chunk)) {
+            WC_STATS_ADD(steals, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Maps FILENAME and queues its chunks on DQ. In -n mode the whole file is one
+ * chunk, so that no n-gram is cut in two. Returns the mapping (NULL if the
+ * file could not be read or is empty) and its size in *SIZE.
+ */
+static char *queue_file(const char *filename, deque_t *dq, size_t *size) {
+    struct stat st;
+    char *data;
+    int fd = open(filename, O_RDONLY);
+
+    *size = 0;
+    if (fd == -1 || fstat(fd, &st) != 0) { //throw an error if the file cant be opened
+        fprintf(stderr, "could not open file: %s\n", filename);
+        if (fd != -1) {
+            close(fd);
+        }
+        return NULL;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    *size = st.st_size;
+
+    size_t step = (ngram_n > 0) ? *size : CHUNK_SIZE;
+    for (size_t start = 0; start < *size;) {
+        size_t end = (*size - start > step) ? start + step : *size;
+        while (end < *size && isalpha((unsigned char) data[end])) {
+            end++; //don't cut a word in half
+        }
+        if (!deque_push(dq, (chunk_t) {data + start, end - start})) {
+            break;
+        }
+        start = end;
+    }
+    return data;
+}
+
 void *thread_function(void *arg) {
     threadStruct *threadArg = (threadStruct *)arg;
-    FILE *file = fopen(threadArg->filename, "r");
-    if (!file) { //throw an error if the file cant be opened
-        fprintf(stderr, "could not open file: %s\n", threadArg->filename);
-        free(threadArg);
-        return NULL;
+    chunk_t chunk;
+    attach_stats("worker", threadArg->id, wc_pin_self(pin_policy, threadArg->id));
+#ifdef WC_STATS
+    threadArg->stats = wc_stats_self;
+#endif
+    while (next_chunk(threadArg->id, &chunk)) {
+        WC_STATS_NOW(busy_start);
+        if (ngram_n > 0) {
+            count_ngrams_in(&threadArg->grams, chunk.data, chunk.len);
+        } else {
+            count_words_in(&threadArg->wclist, chunk.data, chunk.len);
+        }
+        WC_STATS_SINCE(busy_ns, busy_start);
+        WC_STATS_ADD(chunks, 1);
+    }
+    if (ngram_n == 0) { //n-grams are merged by main, nothing to partition
+        WC_STATS_NOW(busy_start);
+        //hand each word to the merger that owns its hash range
+        partition_words(&threadArg->wclist, threadArg->parts, nparts);
+        WC_STATS_SINCE(busy_ns, busy_start);
+    }
+    return NULL;
+}
+
+void *merge_function(void *arg) {
+    mergeStruct *mergeArg = (mergeStruct *)arg;
+    attach_stats("merge", mergeArg->index, wc_pin_self(pin_policy, mergeArg->index));
+    WC_STATS_NOW(busy_start);
+    init_words(mergeArg->part);
+    if (use_arenas) { //absorbed entries live in the workers' arenas
+        words_use_arena(mergeArg->part, mergeArg->workers[0].wclist.arena);
+    }
+    for (int w = 0; w < mergeArg->num_workers; w++) {
+        absorb_words(mergeArg->part, &mergeArg->workers[w].parts[mergeArg->index]);
     }
-    //if you CAN open then count and close file
-    count_words(threadArg->wclist, file);
-    fclose(file);
-    free(threadArg);
+    //sorting each range here means the final sort sees sorted data
+    wordcount_sort(mergeArg->part, less_count);
+    WC_STATS_SINCE(busy_ns, busy_start);
     return NULL;
 }
 
+/* Online CPUs, at least one. */
+static size_t online_cpus(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus < 1) ? 1 : cpus;
+}
+
+/* Number of merge threads: one per core, but never more than the workers. */
+static size_t merge_width(size_t num_workers) {
+    size_t cpus = online_cpus();
+    return (num_workers < cpus) ? num_workers : cpus;
+}
+
 /*
- * main - handle command line, spawning one thread per file.
+ * Counts FILES on nworkers threads and leaves the result in WORD_COUNTS, or in
+ * GRAMS in -n mode.
  */
-int main(int argc, char *argv[]) {
-    /* Create the empty data structure. */
-    word_count_list_t word_counts;
-    init_words(&word_counts); //the shared list to use in thread function
+static void count_files(int num_files, char *files[],
+                        word_count_list_t *word_counts, ngram_table_t *grams) {
+    char *maps[num_files];
+    size_t sizes[num_files];
+    deque_t dqs[nworkers];
 
-    if (argc <= 1) {
-        /* Process stdin in a single thread. */
-        count_words(&word_counts, stdin);
-    } else {
-        //argc = number of elements in argv
-        //argv[0] = ./pwords, argv[1] = file1.txt, etc...
-        int num_files = argc - 1; 
-        //one thread per file put in an array
-        pthread_t threads[num_files];
-
-        for (int i = 0; i < num_files; i++) {
-            //for each file, allocate memory for filename/list (threadStruct)
-            threadStruct *threadArg = malloc(sizeof(threadStruct));
-            if (!threadArg) { //if can't allocate mem
-                fprintf(stderr, "could not allocate memory for thread arg\n");
+    nparts = merge_width(nworkers);
+    deques = dqs;
+    for (size_t w = 0; w < nworkers; w++) {
+        dqs[w] = (deque_t) {.lock = PTHREAD_MUTEX_INITIALIZER};
+    }
+    //file i starts out on worker i (mod nworkers), like one thread per file
+    for (int i = 0; i < num_files; i++) {
+        maps[i] = queue_file(files[i], &dqs[i % nworkers], &sizes[i]);
+    }
+
+    pthread_t threads[nworkers];
+    bool started[nworkers];
+    threadStruct workers[nworkers];
+    struct list parts[nworkers][nparts];
+#ifdef WC_STATS
+    uint64_t phase_start = wc_stats_now();
+#endif
+
+    for (size_t w = 0; w < nworkers; w++) {
+        workers[w] = (threadStruct) {.id = w, .parts = parts[w]};
+        init_words(&workers[w].wclist);
+        if (use_arenas) { //nothing is mapped until the worker's first word
+            wc_arena_t *arena = malloc(sizeof(wc_arena_t));
+            if (arena == NULL) { //every list must agree on arenas, so give up
+                perror("malloc");
                 exit(1);
             }
+            wc_arena_init(arena, pages_kind);
+            words_use_arena(&workers[w].wclist, arena);
+        }
+        if (ngram_n > 0) {
+            ngram_init(&workers[w].grams, ngram_n);
+        }
+        for (size_t r = 0; r < nparts; r++) {
+            list_init(&parts[w][r]);
+        }
+        int rc = pthread_create(&threads[w], NULL, thread_function, &workers[w]);
+        started[w] = (rc == 0);
+        if (rc != 0) { //the other workers will steal its chunks
+            fprintf(stderr, "could not create worker thread %zu\n", w);
+        }
+    }
+    if (!started[0]) {
+        thread_function(&workers[0]); //make sure somebody empties the deques
+    }
+
+    //join all the threads (so program has to wait for all threads to finish before exiting)
+    for (size_t w = 0; w < nworkers; w++) {
+        if (started[w]) {
+            pthread_join(threads[w], NULL);
+        }
+    }
+#ifdef WC_STATS
+    //idle = time in the counting phase not spent on chunks or partitioning
+    uint64_t phase_ns = wc_stats_now() - phase_start;
+    for (size_t w = 0; w < nworkers; w++) {
+        wc_thread_stats_t *s = workers[w].stats;
+        if (s != NULL && phase_ns > s->busy_ns) {
+            s->idle_ns = phase_ns - s->busy_ns;
+        }
+    }
+#endif
+    for (int i = 0; i < num_files; i++) {
+        if (maps[i] != NULL) {
+            munmap(maps[i], sizes[i]);
+        }
+    }
+    for (size_t w = 0; w < nworkers; w++) {
+        free(dqs[w].chunks);
+        pthread_mutex_destroy(&dqs[w].lock);
+    }
 
-            threadArg->filename = argv[i + 1]; //skip the program's name
-            threadArg->wclist = &word_counts; //reference to shared list
+    if (ngram_n > 0) { //tables keyed by word IDs don't split by hash
+        for (size_t w = 0; w < nworkers; w++) {
+            ngram_merge(grams, &workers[w].grams);
+            ngram_destroy(&workers[w].grams);
+        }
+        return;
+    }
 
-            //make new thread w/ thread ID stored in &threads[i]
-            int rc = pthread_create(&threads[i], NULL, thread_function, threadArg);
-            if (rc != 0) {
-                fprintf(stderr, "could not create thread for file: %s\n", argv[i + 1]);
-                free(threadArg);
-                continue;
+    //merge: one thread per hash range, all running at once
+    pthread_t mergers[nparts];
+    mergeStruct mergeArgs[nparts];
+    word_count_list_t merged[nparts];
+    for (size_t r = 0; r < nparts; r++) {
+        mergeArgs[r] = (mergeStruct) {r, workers, nworkers, &merged[r]};
+        if (pthread_create(&mergers[r], NULL, merge_function, &mergeArgs[r]) != 0) {
+            merge_function(&mergeArgs[r]); //just do it on this thread
+            mergers[r] = pthread_self();
+        }
+    }
+    for (size_t r = 0; r < nparts; r++) {
+        if (!pthread_equal(mergers[r], pthread_self())) {
+            pthread_join(mergers[r], NULL);
+        }
+    }
+    merge_sorted_words(word_counts, merged, nparts, less_count);
+}
+
+/*
+ * main - handle command line, counting the files on a pool of worker threads.
+ *
+ * Options:
+ *   --stats  print per-thread counters (including busy and idle time) and a
+ *            lock hold-time histogram to stderr at exit (only if built with
+ *            STATS=1)
+ *   -j N     use N worker threads instead of one per online CPU
+ *   --pin none|compact|scatter
+ *            pin workers and mergers to CPUs, filling one NUMA node at a
+ *            time or spreading across nodes
+ *   --pages small|thp|hugetlb
+ *            allocate entries and words from per-worker arenas backed by
+ *            ordinary, transparent huge or hugetlbfs pages
+ *   -n N     count runs of N consecutive words instead of single words
+ */
+int main(int argc, char *argv[]) {
+    /* Create the empty data structure. */
+    word_count_list_t word_counts;
+    init_words(&word_counts); //the final list everything gets merged into
+
+    bool stats = false;
+    nworkers = online_cpus();
+    while (argc > 1) {
+        if (strcmp(argv[1], "--stats") == 0) {
+            stats = true;
+        } else if (strcmp(argv[1], "-n") == 0 && argc > 2) {
+            if ((ngram_n = ngram_parse_n(argv[2])) == 0) {
+                fprintf(stderr, "-n: expected 1..%d\n", NGRAM_MAX);
+                return 1;
+            }
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+            char *end;
+            long j = strtol(argv[2], &end, 10);
+            if (*end != '\0' || j < 1 || j > 1024) {
+                fprintf(stderr, "-j: expected 1..1024\n");
+                return 1;
+            }
+            nworkers = j;
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--pin") == 0 && argc > 2) {
+            if (!wc_pin_parse(argv[2], &pin_policy)) {
+                fprintf(stderr, "--pin: expected none, compact or scatter\n");
+                return 1;
             }
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--pages") == 0 && argc > 2) {
+            if (!wc_pages_parse(argv[2], &pages_kind)) {
+                fprintf(stderr, "--pages: expected small, thp or hugetlb\n");
+                return 1;
+            }
+            use_arenas = true;
+            argv++;
+            argc--;
+        } else {
+            break;
         }
+        argv++;
+        argc--;
+    }
+#ifdef WC_STATS
+    if (stats) {
+        wc_stats_enable();
+    }
+#else
+    if (stats) {
+        fprintf(stderr, "pwords: built without STATS=1, ignoring --stats\n");
+    }
+#endif
 
-        //join all the threads (so program has to wait for all threads to finish before exiting)
-        for (int i = 0; i < num_files; i++) {
-            pthread_join(threads[i], NULL);
+    ngram_table_t grams;
+    if (ngram_n > 0 && !ngram_init(&grams, ngram_n)) {
+        return 1;
+    }
+
+    if (argc <= 1) {
+        /* Process stdin in a single thread. */
+        WC_STATS_ATTACH("<stdin>");
+        WC_STATS_NOW(busy_start);
+        if (ngram_n > 0) {
+            count_ngrams(&grams, stdin);
+        } else {
+            count_words(&word_counts, stdin);
         }
+        WC_STATS_SINCE(busy_ns, busy_start);
+    } else {
+        //argc = number of elements in argv
+        //argv[0] = ./pwords, argv[1] = file1.txt, etc...
+        count_files(argc - 1, argv + 1, &word_counts, &grams);
     }
 
     /* Output final result of all threads' work. */
-    wordcount_sort(&word_counts, less_count);
-    fprint_words(&word_counts, stdout);
+    if (ngram_n > 0) {
+        ngram_print(&grams, stdout, false);
+        ngram_destroy(&grams);
+    } else {
+        wordcount_sort(&word_counts, less_count);
+        fprint_words(&word_counts, stdout);
+    }
+#ifdef WC_STATS
+    fflush(stdout);
+    wc_stats_report(stderr);
+#endif
     return 0;
 }
@@ -0,0 +1,169 @@
+/*
+ * Implementation of the readahead interface.
+ *
+ * A helper thread fills the ring in order and the reader drains it in order.
+ * If the helper cannot be started the reader fills buffers itself, which
+ * behaves like a plain buffered read.
+ */
+
+#include "readahead.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "wc_stats.h"
+
+/* Reads until BUF is full or the descriptor hits end of file. */
+static ssize_t read_full(int fd, unsigned char *buf, size_t cap) {
+    size_t n = 0;
+    while (n < cap) {
+        ssize_t rv = read(fd, buf + n, cap - n);
+        if (rv == 0) {
+            break;
+        } else if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (n > 0) ? (ssize_t) n : -1;
+        }
+        n += rv;
+    }
+    return n;
+}
+
+static void *helper_main(void *arg) {
+    readahead_t *ra = arg;
+
+    for (;;) {
+        size_t idx;
+        ssize_t n;
+
+        pthread_mutex_lock(&ra->lock);
+        while (ra->count == RA_NBUFS && !ra->stop) {
+            pthread_cond_wait(&ra->drained, &ra->lock);
+        }
+        if (ra->stop) {
+            pthread_mutex_unlock(&ra->lock);
+            break;
+        }
+        idx = ra->tail;
+        pthread_mutex_unlock(&ra->lock);
+
+        n = read_full(ra->fd, ra->bufs[idx].data, RA_BUFSIZE);
+
+        pthread_mutex_lock(&ra->lock);
+        if (n > 0) {
+            ra->bufs[idx].len = n;
+            ra->tail = (ra->tail + 1) % RA_NBUFS;
+            ra->count++;
+        }
+        if (n < RA_BUFSIZE) {
+            ra->error = (n < 0) ? errno : 0;
+            ra->eof = true;
+        }
+        pthread_cond_signal(&ra->filled);
+        pthread_mutex_unlock(&ra->lock);
+        if (n < RA_BUFSIZE) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+readahead_t *readahead_open(FILE *infile) {
+    readahead_t *ra;
+
+    if ((ra = calloc(1, sizeof(readahead_t))) == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    ra->fd = fileno(infile);
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->filled, NULL);
+    pthread_cond_init(&ra->drained, NULL);
+    for (int i = 0; i < RA_NBUFS; i++) {
+        if ((ra->bufs[i].data = malloc(RA_BUFSIZE)) == NULL) {
+            perror("malloc");
+            readahead_close(ra);
+            return NULL;
+        }
+    }
+
+    /* Let the kernel widen its own read-ahead window; fails on pipes. */
+    posix_fadvise(ra->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    ra->threaded = pthread_create(&ra->helper, NULL, helper_main, ra) == 0;
+    return ra;
+}
+
+void readahead_close(readahead_t *ra) {
+    if (ra == NULL) {
+        return;
+    }
+    if (ra->threaded) {
+        pthread_mutex_lock(&ra->lock);
+        ra->stop = true;
+        pthread_cond_signal(&ra->drained);
+        pthread_mutex_unlock(&ra->lock);
+        pthread_join(ra->helper, NULL);
+    }
+    pthread_cond_destroy(&ra->drained);
+    pthread_cond_destroy(&ra->filled);
+    pthread_mutex_destroy(&ra->lock);
+    for (int i = 0; i < RA_NBUFS; i++) {
+        free(ra->bufs[i].data);
+    }
+    free(ra);
+}
+
+int readahead_refill(readahead_t *ra) {
+    if (!ra->threaded) {
+        ssize_t n = ra->eof ? 0 : read_full(ra->fd, ra->bufs[0].data,
+                                             RA_BUFSIZE);
+        if (n < 0) {
+            perror("read");
+        }
+        if (n <= 0) {
+            ra->eof = true;
+            ra->len = ra->pos = 0;
+            return EOF;
+        }
+        ra->cur = ra->bufs[0].data;
+        ra->len = n;
+        ra->pos = 0;
+        WC_STATS_ADD(bytes_read, n);
+        return ra->cur[ra->pos++];
+    }
+
+    pthread_mutex_lock(&ra->lock);
+    if (ra->holding) {
+        /* Hand the drained buffer back to the helper. */
+        ra->head = (ra->head + 1) % RA_NBUFS;
+        ra->count--;
+        ra->holding = false;
+        pthread_cond_signal(&ra->drained);
+    }
+    while (ra->count == 0 && !ra->eof) {
+        pthread_cond_wait(&ra->filled, &ra->lock);
+    }
+    if (ra->count == 0) {
+        if (ra->error != 0) {
+            errno = ra->error;
+            perror("read");
+            ra->error = 0;
+        }
+        pthread_mutex_unlock(&ra->lock);
+        ra->len = ra->pos = 0;
+        return EOF;
+    }
+    ra->holding = true;
+    ra->cur = ra->bufs[ra->head].data;
+    ra->len = ra->bufs[ra->head].len;
+    ra->pos = 0;
+    pthread_mutex_unlock(&ra->lock);
+
+    WC_STATS_ADD(bytes_read, ra->len);
+    return ra->cur[ra->pos++];
+}
@@ -0,0 +1,75 @@
+/*
+ * The readahead interface reads a file descriptor through a ring of large
+ * buffers that a helper thread keeps filled, so that tokenizing buffer k
+ * overlaps with reading buffer k+1.
+ */
+
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Number of buffers in the ring and size of each one. */
+#define RA_NBUFS 4
+#define RA_BUFSIZE (128 * 1024)
+
+typedef struct readahead {
+    /* Buffer currently being consumed. Only touched by the reader. */
+    const unsigned char *cur;
+    size_t pos;
+    size_t len;
+    bool holding;
+
+    int fd;
+    bool threaded;
+    pthread_t helper;
+
+    /* Ring state, protected by lock. */
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t drained;
+    struct {
+        unsigned char *data;
+        size_t len;
+    } bufs[RA_NBUFS];
+    size_t head;  /* Next buffer to consume. */
+    size_t tail;  /* Next buffer to fill. */
+    size_t count; /* Filled buffers, including the one being consumed. */
+    bool eof;
+    bool stop;
+    int error;
+} readahead_t;
+
+/*
+ * Starts reading INFILE's descriptor ahead of the caller. INFILE must not have
+ * been read through stdio yet. Returns NULL on allocation failure.
+ */
+readahead_t *readahead_open(FILE *infile);
+
+/*
+ * Sets up RA to read the LEN bytes at BUF instead of a descriptor. There is no
+ * helper thread or ring, and RA must not be passed to readahead_close.
+ */
+static inline void readahead_init_buffer(readahead_t *ra, const void *buf,
+                                         size_t len) {
+    *ra = (readahead_t) {.cur = buf, .len = len, .fd = -1, .eof = true};
+}
+
+/* Stops the helper thread and frees RA. Does not close the descriptor. */
+void readahead_close(readahead_t *ra);
+
+/* Moves to the next filled buffer. Returns its first byte, or EOF. */
+int readahead_refill(readahead_t *ra);
+
+/* Returns the next byte of input, or EOF. */
+static inline int readahead_getc(readahead_t *ra) {
+    if (ra->pos < ra->len) {
+        return ra->cur[ra->pos++];
+    }
+    return readahead_refill(ra);
+}
+
+#endif /* READAHEAD_H */
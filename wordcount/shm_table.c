@@ -0,0 +1,218 @@
+/*
+ * Implementation of the shm_table interface.
+ *
+ * Region layout: a header, then bucket arrays and entries allocated bump-style
+ * from USED. Each bucket heads a chain of entries linked by offset (0 ends the
+ * chain). When the load factor passes one, a bucket array twice the size is
+ * carved from the end of the region and every entry is relinked; the old
+ * array is simply abandoned. The region grows with ftruncate + mremap, which
+ * is safe precisely because nothing in it is a pointer.
+ */
+
+#define _GNU_SOURCE
+
+#include "shm_table.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_TABLE_MAGIC 0x77637368 /* "wcsh" */
+#define INITIAL_CAP (1u << 20)
+#define INITIAL_BUCKETS 1024
+
+typedef struct shm_header {
+    uint32_t magic;
+    uint32_t nbuckets;
+    uint64_t buckets; /* Offset of the current bucket array. */
+    uint64_t used;
+    uint64_t nentries;
+} shm_header_t;
+
+typedef struct shm_entry {
+    uint64_t next;
+    uint64_t hash;
+    int32_t count;
+    uint32_t len;
+    char word[]; /* NUL-terminated. */
+} shm_entry_t;
+
+#define HDR(t) ((shm_header_t *) (t)->base)
+#define AT(t, off) ((void *) ((t)->base + (off)))
+
+static uint64_t hash_word(const char *word, size_t len) {
+    uint64_t h = 14695981039346656037ull; /* FNV-1a */
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) word[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* Reserves SIZE bytes (8-aligned) at the end of the region. Returns 0 on
+ * failure, since offset 0 is always the header. */
+static uint64_t alloc_bytes(shm_table_t *table, size_t size) {
+    uint64_t off;
+
+    size = (size + 7) & ~(size_t) 7;
+    if (HDR(table)->used + size > table->cap) {
+        size_t cap = table->cap;
+        char *base;
+        while (cap < HDR(table)->used + size) {
+            cap *= 2;
+        }
+        if (ftruncate(table->fd, cap) != 0) {
+            perror("ftruncate");
+            return 0;
+        }
+        base = mremap(table->base, table->cap, cap, MREMAP_MAYMOVE);
+        if (base == MAP_FAILED) {
+            perror("mremap");
+            return 0;
+        }
+        table->base = base;
+        table->cap = cap;
+    }
+    off = HDR(table)->used;
+    HDR(table)->used += size;
+    return off;
+}
+
+static bool rehash(shm_table_t *table) {
+    uint32_t nbuckets = HDR(table)->nbuckets * 2;
+    uint64_t old_off = HDR(table)->buckets, new_off;
+    uint32_t old_n = HDR(table)->nbuckets;
+
+    if ((new_off = alloc_bytes(table, nbuckets * sizeof(uint64_t))) == 0) {
+        return false;
+    }
+    /* alloc_bytes may have moved the region; recompute every address. */
+    uint64_t *old = AT(table, old_off), *new = AT(table, new_off);
+    memset(new, 0, nbuckets * sizeof(uint64_t));
+    for (uint32_t b = 0; b < old_n; b++) {
+        uint64_t off = old[b];
+        while (off != 0) {
+            shm_entry_t *e = AT(table, off);
+            uint64_t next = e->next;
+            e->next = new[e->hash & (nbuckets - 1)];
+            new[e->hash & (nbuckets - 1)] = off;
+            off = next;
+        }
+    }
+    HDR(table)->buckets = new_off;
+    HDR(table)->nbuckets = nbuckets;
+    return true;
+}
+
+bool shm_table_create(shm_table_t *table, int fd) {
+    uint64_t buckets;
+
+    table->fd = fd;
+    table->cap = INITIAL_CAP;
+    if (ftruncate(fd, table->cap) != 0) {
+        perror("ftruncate");
+        return false;
+    }
+    table->base = mmap(NULL, table->cap, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+    if (table->base == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    *HDR(table) = (shm_header_t) {.magic = SHM_TABLE_MAGIC,
+                                  .nbuckets = INITIAL_BUCKETS,
+                                  .used = sizeof(shm_header_t)};
+    if ((buckets = alloc_bytes(table, INITIAL_BUCKETS * sizeof(uint64_t))) ==
+        0) {
+        return false;
+    }
+    /* ftruncate zero-fills, so the buckets start out empty. */
+    HDR(table)->buckets = buckets;
+    return true;
+}
+
+bool shm_table_add(shm_table_t *table, const char *word, size_t len,
+                   int count) {
+    uint64_t hash = hash_word(word, len), *bucket, off;
+    shm_entry_t *e;
+
+    bucket = (uint64_t *) AT(table, HDR(table)->buckets) +
+             (hash & (HDR(table)->nbuckets - 1));
+    for (off = *bucket; off != 0; off = e->next) {
+        e = AT(table, off);
+        if (e->hash == hash && e->len == len && memcmp(e->word, word, len) == 0) {
+            e->count += count;
+            return true;
+        }
+    }
+
+    if ((off = alloc_bytes(table, sizeof(shm_entry_t) + len + 1)) == 0) {
+        return false;
+    }
+    e = AT(table, off);
+    e->hash = hash;
+    e->count = count;
+    e->len = len;
+    memcpy(e->word, word, len);
+    e->word[len] = '\0';
+
+    /* The region may have moved while allocating the entry. */
+    bucket = (uint64_t *) AT(table, HDR(table)->buckets) +
+             (hash & (HDR(table)->nbuckets - 1));
+    e->next = *bucket;
+    *bucket = off;
+
+    if (++HDR(table)->nentries > HDR(table)->nbuckets) {
+        return rehash(table);
+    }
+    return true;
+}
+
+bool shm_table_map(shm_table_t *table, int fd) {
+    struct stat st;
+
+    table->fd = fd;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        return false;
+    }
+    table->cap = st.st_size;
+    if (table->cap < sizeof(shm_header_t)) {
+        fprintf(stderr, "shm_table: region too small\n");
+        return false;
+    }
+    table->base = mmap(NULL, table->cap, PROT_READ, MAP_SHARED, fd, 0);
+    if (table->base == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    if (HDR(table)->magic != SHM_TABLE_MAGIC || HDR(table)->used > table->cap) {
+        fprintf(stderr, "shm_table: corrupt region\n");
+        shm_table_unmap(table);
+        return false;
+    }
+    return true;
+}
+
+void shm_table_for_each(shm_table_t *table,
+                        void fn(const char *word, int count, void *aux),
+                        void *aux) {
+    uint64_t *buckets = AT(table, HDR(table)->buckets);
+
+    for (uint32_t b = 0; b < HDR(table)->nbuckets; b++) {
+        for (uint64_t off = buckets[b]; off != 0;) {
+            shm_entry_t *e = AT(table, off);
+            fn(e->word, e->count, aux);
+            off = e->next;
+        }
+    }
+}
+
+void shm_table_unmap(shm_table_t *table) {
+    if (table->base != NULL && table->base != MAP_FAILED) {
+        munmap(table->base, table->cap);
+    }
+    table->base = NULL;
+}
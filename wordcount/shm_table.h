@@ -0,0 +1,43 @@
+/*
+ * The shm_table interface is a word count hash table that lives entirely in
+ * one shared memory region. Links are byte offsets from the start of the
+ * region rather than pointers, so the table stays valid wherever the region
+ * is mapped: a child process can build it and its parent can read it in
+ * place, with no serialization in between.
+ */
+
+#ifndef SHM_TABLE_H
+#define SHM_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct shm_table {
+    int fd;
+    char *base;
+    size_t cap;
+} shm_table_t;
+
+/*
+ * Creates an empty table in the shared memory object FD (e.g. a memfd) and
+ * maps it for writing.
+ */
+bool shm_table_create(shm_table_t *table, int fd);
+
+/* Adds COUNT to WORD[0..LEN), inserting it if absent. */
+bool shm_table_add(shm_table_t *table, const char *word, size_t len,
+                   int count);
+
+/* Maps the table previously built in FD for reading. */
+bool shm_table_map(shm_table_t *table, int fd);
+
+/* Calls FN on every word (NUL-terminated) and its count. */
+void shm_table_for_each(shm_table_t *table,
+                        void fn(const char *word, int count, void *aux),
+                        void *aux);
+
+/* Unmaps the table. Does not close its descriptor. */
+void shm_table_unmap(shm_table_t *table);
+
+#endif /* SHM_TABLE_H */
@@ -0,0 +1,141 @@
+/*
+ * Implementation of the wc_arena interface.
+ *
+ * Each block starts with a small header linking it to the previous one. An
+ * allocation that does not fit in the current block's remainder starts a new
+ * block; one larger than a block gets a mapping of its own.
+ */
+
+#define _GNU_SOURCE
+
+#include "wc_arena.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HUGE_PAGE (2u << 20)
+
+struct wc_arena_block {
+    struct wc_arena_block *next;
+    size_t size;
+};
+
+#define HEADER ((sizeof(struct wc_arena_block) + 7) & ~(size_t) 7)
+
+static size_t round_huge(size_t size) {
+    return (size + HUGE_PAGE - 1) & ~(size_t) (HUGE_PAGE - 1);
+}
+
+/* Maps SIZE bytes starting on a huge page boundary, so THP can back all of
+ * it: over-allocate by one huge page and trim both ends. */
+static void *map_aligned(size_t size) {
+    char *raw = mmap(NULL, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char *addr;
+
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    addr = (char *) round_huge((uintptr_t) raw);
+    if (addr > raw) {
+        munmap(raw, addr - raw);
+    }
+    munmap(addr + size, raw + HUGE_PAGE - addr); /* Never empty. */
+    return addr;
+}
+
+void *wc_pages_map(size_t size, wc_pages_t pages) {
+    static bool warned;
+    void *addr;
+
+    size = round_huge(size);
+    if (pages == WC_PAGES_HUGETLB) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            return addr;
+        }
+        if (!__atomic_exchange_n(&warned, true, __ATOMIC_RELAXED)) {
+            perror("mmap(MAP_HUGETLB), falling back to transparent huge pages");
+        }
+        pages = WC_PAGES_THP;
+    }
+    if (pages == WC_PAGES_THP) {
+        if ((addr = map_aligned(size)) != NULL) {
+            madvise(addr, size, MADV_HUGEPAGE);
+        }
+        return addr;
+    }
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (addr == MAP_FAILED) ? NULL : addr;
+}
+
+void wc_pages_unmap(void *addr, size_t size) {
+    if (addr != NULL) {
+        munmap(addr, round_huge(size));
+    }
+}
+
+void wc_arena_init(wc_arena_t *arena, wc_pages_t pages) {
+    *arena = (wc_arena_t) {.pages = pages};
+}
+
+void *wc_arena_alloc(wc_arena_t *arena, size_t size) {
+    void *p;
+
+    size = (size + 7) & ~(size_t) 7;
+    if (size > arena->left) {
+        size_t block_size = (size + HEADER > WC_ARENA_BLOCK)
+                                ? round_huge(size + HEADER)
+                                : WC_ARENA_BLOCK;
+        struct wc_arena_block *block = wc_pages_map(block_size, arena->pages);
+        if (block == NULL) {
+            perror("mmap");
+            return NULL;
+        }
+        block->next = arena->blocks;
+        block->size = block_size;
+        arena->blocks = block;
+        arena->next = (char *) block + HEADER;
+        arena->left = block_size - HEADER;
+    }
+    p = arena->next;
+    arena->next += size;
+    arena->left -= size;
+    return p;
+}
+
+char *wc_arena_strdup(wc_arena_t *arena, const char *word) {
+    size_t len = strlen(word) + 1;
+    char *copy = wc_arena_alloc(arena, len);
+
+    if (copy != NULL) {
+        memcpy(copy, word, len);
+    }
+    return copy;
+}
+
+void wc_arena_release(wc_arena_t *arena) {
+    while (arena->blocks != NULL) {
+        struct wc_arena_block *next = arena->blocks->next;
+        wc_pages_unmap(arena->blocks, arena->blocks->size);
+        arena->blocks = next;
+    }
+    arena->next = NULL;
+    arena->left = 0;
+}
+
+bool wc_pages_parse(const char *arg, wc_pages_t *pages) {
+    static const char *const names[] = {"small", "thp", "hugetlb"};
+
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(arg, names[i]) == 0) {
+            *pages = (wc_pages_t) i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,59 @@
+/*
+ * The wc_arena interface is a bump allocator for word count entries and their
+ * strings. Memory comes from large anonymous mappings that can be backed by
+ * huge pages, so that a table of millions of words spans a few hundred TLB
+ * entries instead of hundreds of thousands. Nothing is freed individually;
+ * wc_arena_release returns everything at once.
+ *
+ * Pages are placed by the kernel's first-touch policy: an arena filled by a
+ * thread pinned to one NUMA node (see wc_pin.h) lives on that node.
+ */
+
+#ifndef WC_ARENA_H
+#define WC_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* How arena blocks are backed. */
+typedef enum wc_pages {
+    WC_PAGES_SMALL,   /* Ordinary 4 KiB pages. */
+    WC_PAGES_THP,     /* madvise(MADV_HUGEPAGE) on 2 MiB-aligned blocks. */
+    WC_PAGES_HUGETLB, /* MAP_HUGETLB from the reserved pool, else THP. */
+} wc_pages_t;
+
+/* Size of each block an arena maps (a multiple of the huge page size). */
+#define WC_ARENA_BLOCK (32u << 20)
+
+typedef struct wc_arena {
+    wc_pages_t pages;
+    struct wc_arena_block *blocks;
+    char *next;
+    size_t left;
+} wc_arena_t;
+
+/* Initializes an empty arena. No memory is mapped until the first alloc. */
+void wc_arena_init(wc_arena_t *arena, wc_pages_t pages);
+
+/* Returns SIZE bytes aligned to 8, or NULL if no memory could be mapped. */
+void *wc_arena_alloc(wc_arena_t *arena, size_t size);
+
+/* Copies WORD into the arena. */
+char *wc_arena_strdup(wc_arena_t *arena, const char *word);
+
+/* Unmaps every block. */
+void wc_arena_release(wc_arena_t *arena);
+
+/*
+ * Maps SIZE bytes (rounded up to 2 MiB) backed as PAGES, for large arrays
+ * that are not worth an arena. Returns NULL on failure.
+ */
+void *wc_pages_map(size_t size, wc_pages_t pages);
+
+/* Unmaps memory from wc_pages_map. */
+void wc_pages_unmap(void *addr, size_t size);
+
+/* Parses "small", "thp" or "hugetlb". */
+bool wc_pages_parse(const char *arg, wc_pages_t *pages);
+
+#endif /* WC_ARENA_H */
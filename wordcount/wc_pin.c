@@ -0,0 +1,135 @@
+/*
+ * Implementation of the wc_pin interface.
+ *
+ * The topology is read once: for every node under /sys/devices/system/node,
+ * the CPUs in its cpulist that this process may run on. Both policies are
+ * then just an ordering of those CPUs.
+ */
+
+#define _GNU_SOURCE
+
+#include "wc_pin.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NODES 64
+
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static int cpu_node[CPU_SETSIZE];
+static int compact_order[CPU_SETSIZE], scatter_order[CPU_SETSIZE];
+static int ncpus;
+
+/* Adds the allowed CPUs of a "0-3,8,10-11" list to NODE_CPUS. */
+static int parse_cpulist(const char *list, const cpu_set_t *allowed,
+                         int node_cpus[]) {
+    int n = 0;
+
+    while (*list != '\0' && *list != '\n') {
+        char *end;
+        long lo = strtol(list, &end, 10), hi = lo;
+        if (end == list) {
+            break;
+        }
+        if (*end == '-') {
+            hi = strtol(end + 1, &end, 10);
+        }
+        for (long cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, allowed)) {
+                node_cpus[n++] = cpu;
+            }
+        }
+        list = (*end == ',') ? end + 1 : end;
+    }
+    return n;
+}
+
+static void read_topology(void) {
+    static int node_cpus[MAX_NODES][CPU_SETSIZE];
+    int node_len[MAX_NODES] = {0}, nnodes = 0;
+    cpu_set_t allowed;
+    char path[64], line[4096];
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        CPU_SET(0, &allowed);
+    }
+    for (int node = 0; node < MAX_NODES; node++) {
+        FILE *f;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+                 node);
+        if ((f = fopen(path, "r")) == NULL) {
+            continue;
+        }
+        if (fgets(line, sizeof(line), f) != NULL) {
+            node_len[nnodes] = parse_cpulist(line, &allowed, node_cpus[nnodes]);
+            for (int i = 0; i < node_len[nnodes]; i++) {
+                cpu_node[node_cpus[nnodes][i]] = node;
+            }
+            nnodes += (node_len[nnodes] > 0);
+        }
+        fclose(f);
+    }
+    if (nnodes == 0) { /* No sysfs: one node holding every allowed CPU. */
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                node_cpus[0][node_len[0]++] = cpu;
+            }
+        }
+        nnodes = 1;
+    }
+
+    for (int node = 0; node < nnodes; node++) {
+        for (int i = 0; i < node_len[node]; i++) {
+            compact_order[ncpus++] = node_cpus[node][i];
+        }
+    }
+    for (int i = 0, n = 0; n < ncpus; i++) {
+        for (int node = 0; node < nnodes; node++) {
+            if (i < node_len[node]) {
+                scatter_order[n++] = node_cpus[node][i];
+            }
+        }
+    }
+}
+
+bool wc_pin_parse(const char *arg, wc_pin_t *policy) {
+    static const char *const names[] = {"none", "compact", "scatter"};
+
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(arg, names[i]) == 0) {
+            *policy = (wc_pin_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+int wc_pin_self(wc_pin_t policy, size_t index) {
+    cpu_set_t set;
+    int cpu;
+
+    if (policy == WC_PIN_NONE) {
+        return -1;
+    }
+    pthread_once(&topology_once, read_topology);
+    if (ncpus == 0) {
+        return -1;
+    }
+    cpu = (policy == WC_PIN_COMPACT ? compact_order
+                                    : scatter_order)[index % ncpus];
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return -1;
+    }
+    return cpu;
+}
+
+int wc_pin_node_of(int cpu) {
+    pthread_once(&topology_once, read_topology);
+    return (cpu >= 0 && cpu < CPU_SETSIZE) ? cpu_node[cpu] : 0;
+}
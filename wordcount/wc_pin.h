@@ -0,0 +1,32 @@
+/*
+ * The wc_pin interface pins worker threads to CPUs according to a policy, so
+ * that each thread stays next to the memory it first touched. The NUMA layout
+ * is read from sysfs; a machine without one is treated as a single node.
+ */
+
+#ifndef WC_PIN_H
+#define WC_PIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum wc_pin {
+    WC_PIN_NONE,    /* Leave placement to the scheduler. */
+    WC_PIN_COMPACT, /* Fill every CPU of node 0, then node 1, ... */
+    WC_PIN_SCATTER, /* Round-robin over nodes, spreading memory bandwidth. */
+} wc_pin_t;
+
+/* Parses "none", "compact" or "scatter". */
+bool wc_pin_parse(const char *arg, wc_pin_t *policy);
+
+/*
+ * Pins the calling thread to the CPU that POLICY gives the INDEXth worker
+ * (wrapping around when there are more workers than CPUs). Returns that CPU,
+ * or -1 if POLICY is WC_PIN_NONE or pinning failed.
+ */
+int wc_pin_self(wc_pin_t policy, size_t index);
+
+/* NUMA node of CPU, or 0 if unknown. */
+int wc_pin_node_of(int cpu);
+
+#endif /* WC_PIN_H */
@@ -0,0 +1,138 @@
+/*
+ * Implementation of the wc_stats interface.
+ *
+ * Each instrumented thread owns one wc_thread_stats_t and updates it without
+ * synchronization; the slots are only read by wc_stats_report() after all
+ * workers have been joined.
+ */
+
+#include "wc_stats.h"
+
+#ifdef WC_STATS
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+__thread wc_thread_stats_t *wc_stats_self;
+
+static bool stats_enabled;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static wc_thread_stats_t **stats_slots;
+static size_t stats_nslots;
+
+uint64_t wc_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+void wc_stats_record_hold(uint64_t ns) {
+    int bucket = 0;
+    while ((ns >> bucket) > 1 && bucket < WC_STATS_HIST_BUCKETS - 1) {
+        bucket++;
+    }
+    wc_stats_self->lock_acquires++;
+    wc_stats_self->lock_hold_ns += ns;
+    wc_stats_self->hold_hist[bucket]++;
+}
+
+void wc_stats_enable(void) {
+    stats_enabled = true;
+}
+
+void wc_stats_attach(const char *name) {
+    wc_thread_stats_t *slot, **slots;
+
+    if (!stats_enabled) {
+        return;
+    }
+    if ((slot = calloc(1, sizeof(wc_thread_stats_t))) == NULL) {
+        perror("calloc");
+        return;
+    }
+    slot->name = name;
+
+    pthread_mutex_lock(&stats_lock);
+    slots = realloc(stats_slots, (stats_nslots + 1) * sizeof(*slots));
+    if (slots == NULL) {
+        pthread_mutex_unlock(&stats_lock);
+        perror("realloc");
+        free(slot);
+        return;
+    }
+    stats_slots = slots;
+    stats_slots[stats_nslots++] = slot;
+    pthread_mutex_unlock(&stats_lock);
+
+    wc_stats_self = slot;
+}
+
+static double ms(uint64_t ns) {
+    return ns / 1e6;
+}
+
+void wc_stats_report(FILE *out) {
+    wc_thread_stats_t total = {.name = "total"};
+    uint64_t max_bucket = 0;
+
+    if (!stats_enabled) {
+        return;
+    }
+
+    fprintf(out, "%-28s %12s %10s %10s %12s %12s %7s %7s %12s %12s %12s\n",
+            "thread", "bytes", "words", "allocs", "busy_ms", "idle_ms",
+            "chunks", "steals", "tokenize_ms", "lock_wait_ms", "lock_hold_ms");
+    for (size_t i = 0; i <= stats_nslots; i++) {
+        wc_thread_stats_t *s = (i < stats_nslots) ? stats_slots[i] : &total;
+        fprintf(out,
+                "%-28s %12llu %10llu %10llu %12.3f %12.3f %7llu %7llu %12.3f "
+                "%12.3f %12.3f\n",
+                s->name, (unsigned long long) s->bytes_read,
+                (unsigned long long) s->words,
+                (unsigned long long) s->allocs, ms(s->busy_ns), ms(s->idle_ns),
+                (unsigned long long) s->chunks, (unsigned long long) s->steals,
+                ms(s->tokenize_ns), ms(s->lock_wait_ns), ms(s->lock_hold_ns));
+        if (i == stats_nslots) {
+            break;
+        }
+        total.bytes_read += s->bytes_read;
+        total.words += s->words;
+        total.allocs += s->allocs;
+        total.lock_acquires += s->lock_acquires;
+        total.lock_wait_ns += s->lock_wait_ns;
+        total.lock_hold_ns += s->lock_hold_ns;
+        total.tokenize_ns += s->tokenize_ns;
+        total.busy_ns += s->busy_ns;
+        total.idle_ns += s->idle_ns;
+        total.chunks += s->chunks;
+        total.steals += s->steals;
+        for (int b = 0; b < WC_STATS_HIST_BUCKETS; b++) {
+            total.hold_hist[b] += s->hold_hist[b];
+        }
+    }
+
+    /* Histogram of lock hold times, one bar per power of two. */
+    fprintf(out, "\nlock hold time histogram (%llu acquisitions)\n",
+            (unsigned long long) total.lock_acquires);
+    for (int b = 0; b < WC_STATS_HIST_BUCKETS; b++) {
+        if (total.hold_hist[b] > max_bucket) {
+            max_bucket = total.hold_hist[b];
+        }
+    }
+    for (int b = 0; b < WC_STATS_HIST_BUCKETS; b++) {
+        if (total.hold_hist[b] == 0) {
+            continue;
+        }
+        int width = (int) (total.hold_hist[b] * 50 / max_bucket);
+        fprintf(out, "  < %10llu ns %10llu ", 2ull << b,
+                (unsigned long long) total.hold_hist[b]);
+        for (int j = 0; j < width; j++) {
+            fputc('#', out);
+        }
+        fputc('\n', out);
+    }
+}
+
+#endif /* WC_STATS */
@@ -0,0 +1,98 @@
+/*
+ * The wc_stats interface collects per-thread counters for the word count
+ * tools: bytes read, words processed, allocations, time spent waiting for and
+ * holding the word count list lock, time spent tokenizing, and time busy and
+ * idle under the pwords chunk scheduler.
+ *
+ * Instrumentation is only compiled in when WC_STATS is #define'd. Otherwise
+ * every WC_STATS_* macro expands to nothing and no code or data is emitted at
+ * the instrumentation points.
+ */
+
+#ifndef WC_STATS_H
+#define WC_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Number of log2(ns) buckets in the lock hold-time histogram. */
+#define WC_STATS_HIST_BUCKETS 32
+
+/* Counters owned by a single thread. Only that thread writes to them. */
+typedef struct wc_thread_stats {
+    const char *name;
+    uint64_t bytes_read;
+    uint64_t words;
+    uint64_t allocs;
+    uint64_t lock_acquires;
+    uint64_t lock_wait_ns;
+    uint64_t lock_hold_ns;
+    uint64_t tokenize_ns;
+    uint64_t busy_ns;
+    uint64_t idle_ns;
+    uint64_t chunks;
+    uint64_t steals;
+    uint64_t hold_hist[WC_STATS_HIST_BUCKETS];
+} wc_thread_stats_t;
+
+#ifdef WC_STATS
+
+/* Stats of the calling thread, or NULL if it is not being instrumented. */
+extern __thread wc_thread_stats_t *wc_stats_self;
+
+/* Monotonic clock in nanoseconds. */
+uint64_t wc_stats_now(void);
+
+/* Records one lock hold of NS nanoseconds for the calling thread. */
+void wc_stats_record_hold(uint64_t ns);
+
+/*
+ * Allocates a stats slot named NAME and makes it the calling thread's slot.
+ * Does nothing unless wc_stats_enable() was called first.
+ */
+void wc_stats_attach(const char *name);
+
+/* Turns on collection for threads that attach afterwards. */
+void wc_stats_enable(void);
+
+/* Prints every attached thread's counters and the merged histogram. */
+void wc_stats_report(FILE *out);
+
+/* Attaches the calling thread as NAME (see wc_stats_attach). */
+#define WC_STATS_ATTACH(name) wc_stats_attach(name)
+
+#define WC_STATS_ADD(field, n)                                                 \
+    do {                                                                       \
+        if (wc_stats_self != NULL)                                             \
+            wc_stats_self->field += (n);                                       \
+    } while (0)
+
+/* Declares VAR holding the current time (0 when not instrumented). */
+#define WC_STATS_NOW(var)                                                      \
+    uint64_t var = (wc_stats_self != NULL) ? wc_stats_now() : 0
+
+/* Adds the time elapsed since START (from WC_STATS_NOW) to FIELD. */
+#define WC_STATS_SINCE(field, start)                                           \
+    do {                                                                       \
+        if (wc_stats_self != NULL)                                             \
+            wc_stats_self->field += wc_stats_now() - (start);                  \
+    } while (0)
+
+/* Records a lock acquired at START (from WC_STATS_NOW) as being released. */
+#define WC_STATS_RELEASE(start)                                                \
+    do {                                                                       \
+        if (wc_stats_self != NULL)                                             \
+            wc_stats_record_hold(wc_stats_now() - (start));                    \
+    } while (0)
+
+#else /* WC_STATS */
+
+#define WC_STATS_ATTACH(name) ((void) 0)
+#define WC_STATS_ADD(field, n) ((void) 0)
+#define WC_STATS_NOW(var)
+#define WC_STATS_SINCE(field, start) ((void) 0)
+#define WC_STATS_RELEASE(start) ((void) 0)
+
+#endif /* WC_STATS */
+
+#endif /* WC_STATS_H */
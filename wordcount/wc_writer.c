@@ -0,0 +1,255 @@
+/*
+ * Implementation of the wc_writer interface.
+ */
+
+#include "wc_writer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Bytes buffered before the serial path hands them to the kernel. */
+#define WRITE_CHUNK (256 * 1024)
+
+/* Outputs with fewer entries than this are formatted on the calling thread. */
+#define PARALLEL_MIN_ENTRIES 65536
+#define PARALLEL_MAX_THREADS 8
+
+/* Worst-case bytes for "%8d\t" plus the trailing newline. */
+#define LINE_OVERHEAD 14
+
+static const char digit_pairs[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+typedef struct out_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} out_buf_t;
+
+/* Formats COUNT as printf's "%8d" into DST and returns the bytes written. */
+static size_t format_count(char *dst, int count) {
+    char tmp[12];
+    char *p = tmp + sizeof(tmp);
+    unsigned int v = (count < 0) ? -(unsigned int) count : (unsigned int) count;
+    size_t len, pad;
+
+    while (v >= 100) {
+        unsigned int idx = (v % 100) * 2;
+        v /= 100;
+        *--p = digit_pairs[idx + 1];
+        *--p = digit_pairs[idx];
+    }
+    if (v >= 10) {
+        *--p = digit_pairs[v * 2 + 1];
+        *--p = digit_pairs[v * 2];
+    } else {
+        *--p = '0' + v;
+    }
+    if (count < 0) {
+        *--p = '-';
+    }
+
+    len = tmp + sizeof(tmp) - p;
+    pad = (len < 8) ? 8 - len : 0;
+    memset(dst, ' ', pad);
+    memcpy(dst + pad, p, len);
+    return pad + len;
+}
+
+static bool reserve(out_buf_t *buf, size_t need) {
+    char *data;
+    size_t cap = (buf->cap != 0) ? buf->cap : WRITE_CHUNK;
+
+    if (buf->len + need <= buf->cap) {
+        return true;
+    }
+    while (cap < buf->len + need) {
+        cap *= 2;
+    }
+    if ((data = realloc(buf->data, cap)) == NULL) {
+        buf->failed = true;
+        return false;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return true;
+}
+
+static bool append_entry(out_buf_t *buf, const wc_entry_t *entry) {
+    size_t word_len = strlen(entry->word);
+    char *p;
+
+    if (!reserve(buf, word_len + LINE_OVERHEAD)) {
+        return false;
+    }
+    p = buf->data + buf->len;
+    p += format_count(p, entry->count);
+    *p++ = '\t';
+    memcpy(p, entry->word, word_len);
+    p += word_len;
+    *p++ = '\n';
+    buf->len = p - buf->data;
+    return true;
+}
+
+/* Writes all of IOV to FD, retrying on short writes. */
+static bool writev_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("writev");
+            return false;
+        }
+        while (iovcnt > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+/* Hands BUFS[0..N) to OUTFILE, bypassing stdio when it has a descriptor. */
+static void emit(FILE *outfile, out_buf_t *bufs, int n) {
+    int fd = fileno(outfile);
+    struct iovec iov[PARALLEL_MAX_THREADS];
+
+    if (fd < 0) {
+        for (int i = 0; i < n; i++) {
+            fwrite(bufs[i].data, 1, bufs[i].len, outfile);
+        }
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        iov[i].iov_base = bufs[i].data;
+        iov[i].iov_len = bufs[i].len;
+    }
+    writev_all(fd, iov, n);
+}
+
+typedef struct chunk_job {
+    const wc_entry_t *entries;
+    size_t n;
+    out_buf_t buf;
+} chunk_job_t;
+
+static void *format_chunk(void *arg) {
+    chunk_job_t *job = arg;
+    for (size_t i = 0; i < job->n; i++) {
+        if (!append_entry(&job->buf, &job->entries[i])) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int parallel_threads(size_t n) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long nthreads = n / (PARALLEL_MIN_ENTRIES / 4);
+
+    if (cpus < nthreads) {
+        nthreads = cpus;
+    }
+    if (nthreads > PARALLEL_MAX_THREADS) {
+        nthreads = PARALLEL_MAX_THREADS;
+    }
+    return (n >= PARALLEL_MIN_ENTRIES && nthreads > 1) ? nthreads : 1;
+}
+
+static bool write_parallel(FILE *outfile, const wc_entry_t *entries, size_t n,
+                           int nthreads) {
+    chunk_job_t jobs[PARALLEL_MAX_THREADS];
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    out_buf_t bufs[PARALLEL_MAX_THREADS];
+    bool ok = true;
+    size_t start = 0;
+    int started = 0;
+
+    for (int i = 0; i < nthreads; i++) {
+        size_t end = n * (i + 1) / nthreads;
+        jobs[i] = (chunk_job_t) {.entries = entries + start, .n = end - start};
+        start = end;
+    }
+    for (; started < nthreads; started++) {
+        if (pthread_create(&threads[started], NULL, format_chunk,
+                           &jobs[started]) != 0) {
+            break;
+        }
+    }
+    /* Format whatever could not be handed to a thread here. */
+    for (int i = started; i < nthreads; i++) {
+        format_chunk(&jobs[i]);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        ok = ok && !jobs[i].buf.failed;
+        bufs[i] = jobs[i].buf;
+    }
+    if (ok) {
+        emit(outfile, bufs, nthreads);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        free(jobs[i].buf.data);
+    }
+    return ok;
+}
+
+static bool write_serial(FILE *outfile, const wc_entry_t *entries, size_t n) {
+    out_buf_t buf = {0};
+
+    for (size_t i = 0; i < n; i++) {
+        if (buf.len > 0 && buf.len + LINE_OVERHEAD + strlen(entries[i].word) >
+                               WRITE_CHUNK) {
+            emit(outfile, &buf, 1);
+            buf.len = 0;
+        }
+        if (!append_entry(&buf, &entries[i])) {
+            break;
+        }
+    }
+    if (!buf.failed) {
+        emit(outfile, &buf, 1);
+    }
+    free(buf.data);
+    return !buf.failed;
+}
+
+void wc_write_entries(FILE *outfile, const wc_entry_t *entries, size_t n) {
+    int nthreads = parallel_threads(n);
+    bool ok;
+
+    /* Anything already buffered in OUTFILE must come out first. */
+    fflush(outfile);
+    if (nthreads > 1) {
+        ok = write_parallel(outfile, entries, n, nthreads);
+    } else {
+        ok = write_serial(outfile, entries, n);
+    }
+    if (!ok) {
+        perror("realloc");
+    }
+}
@@ -0,0 +1,647 @@
+/*
+ * Long-running word count service over a Unix domain socket.
+ *
+ *   wcd serve SOCKET [FILE...]      count FILEs, then serve queries on SOCKET
+ *   wcd lookup SOCKET WORD...       print the count of each WORD
+ *   wcd top SOCKET K                print the K most frequent words
+ *   wcd prefix SOCKET PREFIX [MAX]  print words starting with PREFIX
+ *   wcd ingest SOCKET [FILE...]     add FILEs (or stdin) to the corpus
+ *
+ * The server keeps one master word count table, indexed by a hash, that only
+ * ingestion touches, serialized by ingest_lock. A publisher thread turns it
+ * into an immutable snapshot (sorted by word, plus an index sorted by count)
+ * once a batch of PUBLISH_DOCS documents has been ingested or the oldest
+ * unpublished one is PUBLISH_MS old, so a stream of small documents costs one
+ * snapshot per batch instead of one per document. Queries run against the
+ * snapshot that was current when they started, so readers never wait for
+ * ingestion and ingestion never waits for readers; a snapshot is freed when
+ * its last reader drops it.
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "wc_writer.h"
+#include "wcd_proto.h"
+#include "word_count.h"
+#include "word_helpers.h"
+
+typedef struct snapshot {
+    int refs;
+    size_t n;
+    wc_entry_t *by_word;  /* Alphabetical. */
+    uint32_t *by_count;   /* Indices into by_word, most frequent first. */
+} snapshot_t;
+
+/* A batch of documents is published once it is this big... */
+#define PUBLISH_DOCS 64
+/* ...or its first document is this old. */
+#define PUBLISH_MS 50
+
+/* Master table, only touched with ingest_lock held. */
+static word_count_list_t word_counts;
+static pthread_mutex_t ingest_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Documents ingested since the last snapshot, and when the first came in.
+   Under ingest_lock; publish_cond is signalled when a batch starts or fills. */
+static size_t unpublished;
+static struct timespec first_unpublished;
+static pthread_cond_t publish_cond;
+
+/*
+ * Every master entry that made it into a snapshot, alphabetically. Only the
+ * publisher touches it. Entries are never freed and words never change, so the
+ * pointers stay good without ingest_lock.
+ */
+static word_count_t **order;
+static size_t norder, order_cap;
+
+/* Current snapshot. snap_lock only covers the pointer and reference counts. */
+static snapshot_t *current;
+static pthread_mutex_t snap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n == 0) {
+            return false;
+        } else if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Snapshots. */
+
+static snapshot_t *snapshot_get(void) {
+    snapshot_t *snap;
+    pthread_mutex_lock(&snap_lock);
+    snap = current;
+    snap->refs++;
+    pthread_mutex_unlock(&snap_lock);
+    return snap;
+}
+
+static void snapshot_put(snapshot_t *snap) {
+    bool last;
+    pthread_mutex_lock(&snap_lock);
+    last = --snap->refs == 0;
+    pthread_mutex_unlock(&snap_lock);
+    if (last) {
+        free(snap->by_word);
+        free(snap->by_count);
+        free(snap);
+    }
+}
+
+static int cmp_order_word(const void *a, const void *b) {
+    return strcmp((*(word_count_t *const *) a)->word,
+                  (*(word_count_t *const *) b)->word);
+}
+
+/* by_word of the snapshot being sorted by count; only used by the publisher. */
+static const wc_entry_t *sort_base;
+
+static int cmp_index_count(const void *a, const void *b) {
+    const wc_entry_t *wa = &sort_base[*(const uint32_t *) a];
+    const wc_entry_t *wb = &sort_base[*(const uint32_t *) b];
+    if (wa->count != wb->count) {
+        return (wa->count > wb->count) ? -1 : 1;
+    }
+    return strcmp(wa->word, wb->word);
+}
+
+/*
+ * Brings ORDER up to date with the master table, storing its new length in N.
+ * Returns false if out of memory. The master list keeps insertion order, so the words new since the last call
+ * are its last few entries: only those are sorted, then merged in.
+ */
+static bool order_update(size_t *n) {
+    word_count_t **merged;
+    struct list_elem *e;
+    size_t i, j, k;
+
+    pthread_mutex_lock(&ingest_lock);
+    *n = hash_size(&word_counts.index);
+    if (*n > order_cap) {
+        size_t cap = (order_cap != 0) ? order_cap : 1024;
+        word_count_t **bigger;
+        while (cap < *n) {
+            cap *= 2;
+        }
+        if ((bigger = realloc(order, cap * sizeof(word_count_t *))) == NULL) {
+            pthread_mutex_unlock(&ingest_lock);
+            return false;
+        }
+        order = bigger;
+        order_cap = cap;
+    }
+    e = list_rbegin(&word_counts.lst);
+    for (i = *n; i > norder; i--) {
+        order[i - 1] = list_entry(e, word_count_t, elem);
+        e = list_prev(e);
+    }
+    pthread_mutex_unlock(&ingest_lock);
+
+    if (*n == norder) {
+        return true;
+    }
+    qsort(order + norder, *n - norder, sizeof(word_count_t *), cmp_order_word);
+    if ((merged = malloc(order_cap * sizeof(word_count_t *))) == NULL) {
+        return false;
+    }
+    for (i = 0, j = norder, k = 0; k < *n; k++) {
+        if (j == *n || (i < norder && cmp_order_word(&order[i], &order[j]) < 0)) {
+            merged[k] = order[i++];
+        } else {
+            merged[k] = order[j++];
+        }
+    }
+    free(order);
+    order = merged;
+    norder = *n;
+    return true;
+}
+
+/*
+ * Builds a snapshot of the master table. Words are shared with the master
+ * table, which never frees or changes a word once inserted; counts are copied.
+ * Only the publisher (or serve, before there is one) calls this.
+ */
+static snapshot_t *snapshot_build(void) {
+    snapshot_t *snap;
+    size_t i, n;
+
+    if (!order_update(&n) || (snap = calloc(1, sizeof(snapshot_t))) == NULL) {
+        return NULL;
+    }
+    snap->refs = 1;
+    snap->n = n;
+    snap->by_word = malloc((snap->n + 1) * sizeof(wc_entry_t));
+    snap->by_count = malloc((snap->n + 1) * sizeof(uint32_t));
+    if (snap->by_word == NULL || snap->by_count == NULL) {
+        free(snap->by_word);
+        free(snap->by_count);
+        free(snap);
+        return NULL;
+    }
+    /* Only the counts need the lock; ORDER already has the words in place. */
+    pthread_mutex_lock(&ingest_lock);
+    for (i = 0; i < snap->n; i++) {
+        snap->by_word[i] = (wc_entry_t) {order[i]->count, order[i]->word};
+    }
+    pthread_mutex_unlock(&ingest_lock);
+    for (i = 0; i < snap->n; i++) {
+        snap->by_count[i] = i;
+    }
+    sort_base = snap->by_word;
+    qsort(snap->by_count, snap->n, sizeof(uint32_t), cmp_index_count);
+    return snap;
+}
+
+/* Replaces the current snapshot. */
+static bool snapshot_publish(void) {
+    snapshot_t *snap = snapshot_build(), *old;
+    if (snap == NULL) {
+        perror("snapshot");
+        return false;
+    }
+    pthread_mutex_lock(&snap_lock);
+    old = current;
+    current = snap;
+    pthread_mutex_unlock(&snap_lock);
+    if (old != NULL) {
+        snapshot_put(old);
+    }
+    return true;
+}
+
+/* Publishes a snapshot per batch of ingested documents. */
+static void *publisher(void *arg) {
+    pthread_mutex_lock(&ingest_lock);
+    for (;;) {
+        struct timespec deadline;
+
+        while (unpublished == 0) {
+            pthread_cond_wait(&publish_cond, &ingest_lock);
+        }
+        deadline = first_unpublished;
+        deadline.tv_nsec += PUBLISH_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (unpublished < PUBLISH_DOCS &&
+               pthread_cond_timedwait(&publish_cond, &ingest_lock, &deadline) !=
+                   ETIMEDOUT) {
+        }
+        unpublished = 0;
+        pthread_mutex_unlock(&ingest_lock);
+        snapshot_publish(); /* On failure the next batch tries again. */
+        pthread_mutex_lock(&ingest_lock);
+    }
+    return arg;
+}
+
+/* Counts the words of the document in DOC[0..LEN) into the master table. It
+   shows up in queries once the publisher gets to its batch. */
+static bool ingest(const char *doc, size_t len) {
+    pthread_mutex_lock(&ingest_lock);
+    count_words_in(&word_counts, doc, len);
+    if (unpublished++ == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &first_unpublished);
+        pthread_cond_signal(&publish_cond);
+    } else if (unpublished == PUBLISH_DOCS) {
+        pthread_cond_signal(&publish_cond);
+    }
+    pthread_mutex_unlock(&ingest_lock);
+    return true;
+}
+
+/* Queries. */
+
+/* Index of the first word in SNAP that is not less than KEY. */
+static size_t lower_bound(const snapshot_t *snap, const char *key) {
+    size_t lo = 0, hi = snap->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(snap->by_word[mid].word, key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+typedef struct reply_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+} reply_buf_t;
+
+static bool reply_append(reply_buf_t *buf, const void *src, size_t len) {
+    if (buf->len + len > buf->cap) {
+        size_t cap = (buf->cap != 0) ? buf->cap : 4096;
+        char *data;
+        while (cap < buf->len + len) {
+            cap *= 2;
+        }
+        if ((data = realloc(buf->data, cap)) == NULL) {
+            return false;
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, src, len);
+    buf->len += len;
+    return true;
+}
+
+static bool reply_entry(reply_buf_t *buf, int count, const char *word,
+                        uint32_t *nentries) {
+    wcd_entry_t entry = {count, strlen(word)};
+    if (!reply_append(buf, &entry, sizeof(entry)) ||
+        !reply_append(buf, word, entry.len)) {
+        return false;
+    }
+    (*nentries)++; /* Only whole entries count. */
+    return true;
+}
+
+/* Answers one request into BUF (after the reserved reply header). */
+static uint32_t serve_request(const wcd_request_t *req, char *payload,
+                              reply_buf_t *buf, uint32_t *nentries) {
+    snapshot_t *snap;
+    size_t i;
+    bool ok = true;
+
+    if (req->op == WCD_INGEST) {
+        return ingest(payload, req->len) ? WCD_OK : WCD_EINGEST;
+    }
+
+    /* Stored words are lowercase, so match queries case-insensitively. */
+    for (i = 0; i < req->len; i++) {
+        payload[i] = tolower((unsigned char) payload[i]);
+    }
+
+    snap = snapshot_get();
+    switch (req->op) {
+    case WCD_LOOKUP:
+        i = lower_bound(snap, payload);
+        if (i < snap->n && strcmp(snap->by_word[i].word, payload) == 0) {
+            ok = reply_entry(buf, snap->by_word[i].count, payload, nentries);
+        } else {
+            ok = reply_entry(buf, 0, payload, nentries);
+        }
+        break;
+    case WCD_TOPK:
+        for (i = 0; ok && i < req->arg && i < snap->n; i++) {
+            const wc_entry_t *e = &snap->by_word[snap->by_count[i]];
+            ok = reply_entry(buf, e->count, e->word, nentries);
+        }
+        break;
+    case WCD_PREFIX:
+        for (i = lower_bound(snap, payload);
+             ok && i < snap->n && (req->arg == 0 || *nentries < req->arg) &&
+             strncmp(snap->by_word[i].word, payload, req->len) == 0;
+             i++) {
+            ok = reply_entry(buf, snap->by_word[i].count, snap->by_word[i].word,
+                             nentries);
+        }
+        break;
+    default:
+        snapshot_put(snap);
+        return WCD_EBADOP;
+    }
+    snapshot_put(snap);
+    if (!ok) {
+        /* Drop the partial payload: the header alone, with no entries. */
+        buf->len = sizeof(wcd_reply_t);
+        *nentries = 0;
+        return WCD_ENOMEM;
+    }
+    return WCD_OK;
+}
+
+static void *serve_connection(void *arg) {
+    int fd = (int) (intptr_t) arg;
+    wcd_request_t req;
+    reply_buf_t buf = {0};
+
+    while (read_full(fd, &req, sizeof(req))) {
+        wcd_reply_t reply = {WCD_OK, 0};
+        char *payload = NULL;
+
+        if (req.len > WCD_MAX_PAYLOAD) {
+            reply.status = WCD_ETOOBIG;
+            write_full(fd, &reply, sizeof(reply));
+            break;
+        }
+        if ((payload = malloc(req.len + 1)) == NULL ||
+            !read_full(fd, payload, req.len)) {
+            free(payload);
+            break;
+        }
+        payload[req.len] = '\0';
+
+        buf.len = 0;
+        if (!reply_append(&buf, &reply, sizeof(reply))) {
+            free(payload);
+            break;
+        }
+        reply.status = serve_request(&req, payload, &buf, &reply.nentries);
+        free(payload);
+        memcpy(buf.data, &reply, sizeof(reply));
+        if (!write_full(fd, buf.data, buf.len)) {
+            break;
+        }
+    }
+    free(buf.data);
+    close(fd);
+    return NULL;
+}
+
+static int serve(const char *path, int nfiles, char *files[]) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    pthread_condattr_t attr;
+    pthread_t thread;
+    int listen_fd;
+
+    init_words(&word_counts);
+    for (int i = 0; i < nfiles; i++) {
+        FILE *infile = fopen(files[i], "r");
+        if (infile == NULL) {
+            perror("fopen");
+            return 1;
+        }
+        count_words(&word_counts, infile);
+        fclose(infile);
+    }
+    if (!snapshot_publish()) {
+        return 1;
+    }
+    /* Batch deadlines come from CLOCK_MONOTONIC, so the wait must use it too. */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&publish_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&thread, NULL, publisher, NULL) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+    pthread_detach(thread);
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "wcd: socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 64) != 0) {
+        perror("wcd");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "wcd: serving %zu words on %s\n", current->n, path);
+
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+        if (pthread_create(&thread, NULL, serve_connection,
+                           (void *) (intptr_t) fd) != 0) {
+            perror("pthread_create");
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/* Client side. */
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int fd;
+
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        perror("wcd: connect");
+        exit(1);
+    }
+    return fd;
+}
+
+/* Sends one request and prints the entries of its reply. */
+static bool call(int fd, uint32_t op, uint32_t arg, const char *payload,
+                 size_t len) {
+    wcd_request_t req = {op, arg, len};
+    wcd_reply_t reply;
+    wc_entry_t *entries;
+    bool ok = true;
+
+    if (!write_full(fd, &req, sizeof(req)) || !write_full(fd, payload, len) ||
+        !read_full(fd, &reply, sizeof(reply))) {
+        fprintf(stderr, "wcd: connection lost\n");
+        exit(1);
+    }
+    if (reply.status != WCD_OK) {
+        fprintf(stderr, "wcd: request failed with status %u\n", reply.status);
+        return false;
+    }
+    if ((entries = calloc(reply.nentries + 1, sizeof(wc_entry_t))) == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < reply.nentries && ok; i++) {
+        wcd_entry_t entry;
+        char *word;
+        ok = read_full(fd, &entry, sizeof(entry)) &&
+             (word = malloc(entry.len + 1)) != NULL &&
+             read_full(fd, word, entry.len);
+        if (ok) {
+            word[entry.len] = '\0';
+            entries[i] = (wc_entry_t) {entry.count, word};
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "wcd: truncated reply\n");
+        exit(1);
+    }
+    wc_write_entries(stdout, entries, reply.nentries);
+    for (uint32_t i = 0; i < reply.nentries; i++) {
+        free((char *) entries[i].word);
+    }
+    free(entries);
+    return true;
+}
+
+/* Reads all of INFILE into a malloc'd buffer. */
+static char *slurp(FILE *infile, size_t *len) {
+    size_t cap = 64 * 1024, n;
+    char *buf = malloc(cap), *bigger;
+
+    *len = 0;
+    while (buf != NULL && (n = fread(buf + *len, 1, cap - *len, infile)) > 0) {
+        *len += n;
+        if (*len == cap) {
+            cap *= 2;
+            if ((bigger = realloc(buf, cap)) == NULL) {
+                free(buf);
+                return NULL;
+            }
+            buf = bigger;
+        }
+    }
+    return buf;
+}
+
+static bool ingest_stream(int fd, FILE *infile) {
+    size_t len;
+    char *doc = slurp(infile, &len);
+    bool ok;
+
+    if (doc == NULL) {
+        perror("wcd: read");
+        return false;
+    }
+    ok = call(fd, WCD_INGEST, 0, doc, len);
+    free(doc);
+    return ok;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: wcd serve SOCKET [FILE...]\n"
+                    "       wcd lookup SOCKET WORD...\n"
+                    "       wcd top SOCKET K\n"
+                    "       wcd prefix SOCKET PREFIX [MAX]\n"
+                    "       wcd ingest SOCKET [FILE...]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    const char *cmd, *path;
+    bool ok = true;
+    int fd;
+
+    if (argc < 3) {
+        usage();
+    }
+    cmd = argv[1];
+    path = argv[2];
+    if (strcmp(cmd, "serve") == 0) {
+        return serve(path, argc - 3, argv + 3);
+    }
+
+    fd = connect_to(path);
+    if (strcmp(cmd, "lookup") == 0 && argc > 3) {
+        for (int i = 3; i < argc; i++) {
+            ok = call(fd, WCD_LOOKUP, 0, argv[i], strlen(argv[i])) && ok;
+        }
+    } else if (strcmp(cmd, "top") == 0 && argc == 4) {
+        ok = call(fd, WCD_TOPK, atoi(argv[3]), NULL, 0);
+    } else if (strcmp(cmd, "prefix") == 0 && (argc == 4 || argc == 5)) {
+        ok = call(fd, WCD_PREFIX, (argc == 5) ? atoi(argv[4]) : 0, argv[3],
+                  strlen(argv[3]));
+    } else if (strcmp(cmd, "ingest") == 0) {
+        if (argc == 3) {
+            ok = ingest_stream(fd, stdin);
+        }
+        for (int i = 3; i < argc; i++) {
+            FILE *infile = fopen(argv[i], "r");
+            if (infile == NULL) {
+                perror("fopen");
+                ok = false;
+                continue;
+            }
+            ok = ingest_stream(fd, infile) && ok;
+            fclose(infile);
+        }
+    } else {
+        usage();
+    }
+    close(fd);
+    return ok ? 0 : 1;
+}
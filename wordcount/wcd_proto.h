@@ -0,0 +1,51 @@
+/*
+ * Wire protocol spoken by the wcd word count service over a Unix domain
+ * socket. All integers are in host byte order, since both ends always run on
+ * the same machine.
+ *
+ * Every request is a wcd_request_t followed by LEN payload bytes. Every reply
+ * is a wcd_reply_t followed by NENTRIES entries, each a wcd_entry_t followed
+ * by LEN bytes of word (not NUL-terminated). A connection may carry any
+ * number of requests.
+ */
+
+#ifndef WCD_PROTO_H
+#define WCD_PROTO_H
+
+#include <stdint.h>
+
+/* Largest payload the server accepts in one request. */
+#define WCD_MAX_PAYLOAD (256u * 1024 * 1024)
+
+enum wcd_op {
+    WCD_LOOKUP = 1, /* Payload: one word. Reply: one entry (count 0 if absent). */
+    WCD_TOPK = 2,   /* ARG: K. Reply: K most frequent words, highest first. */
+    WCD_PREFIX = 3, /* Payload: prefix. ARG: limit (0 = all). Alphabetical. */
+    WCD_INGEST = 4, /* Payload: document text. Reply: no entries. */
+};
+
+enum wcd_status {
+    WCD_OK = 0,
+    WCD_EBADOP = 1,
+    WCD_ETOOBIG = 2,
+    WCD_EINGEST = 3,
+    WCD_ENOMEM = 4, /* The reply didn't fit in memory; no entries. */
+};
+
+typedef struct wcd_request {
+    uint32_t op;
+    uint32_t arg;
+    uint32_t len;
+} wcd_request_t;
+
+typedef struct wcd_reply {
+    uint32_t status;
+    uint32_t nentries;
+} wcd_reply_t;
+
+typedef struct wcd_entry {
+    int32_t count;
+    uint32_t len;
+} wcd_entry_t;
+
+#endif /* WCD_PROTO_H */
@@ -23,6 +23,8 @@
 
 #include "word_count.h"
 
+#include "wc_writer.h"
+
 void init_words(word_count_list_t *wclist) {
     /* Initialize word count.  */
     *wclist = NULL;
@@ -54,6 +56,7 @@ word_count_t *add_word(word_count_list_t *wclist, char *word) {
     word_count_t *wc = find_word(wclist, word);
     if (wc != NULL) {
         wc->count++;
+        free(word);
     } else if ((wc = malloc(sizeof(word_count_t))) != NULL) {
         wc->word = word;
         wc->count = 1;
@@ -66,10 +69,22 @@ word_count_t *add_word(word_count_list_t *wclist, char *word) {
 }
 
 void fprint_words(word_count_list_t *wclist, FILE *outfile) {
+    size_t n = len_words(wclist), i = 0;
+    wc_entry_t *entries;
     word_count_t *wc;
+
+    if (n == 0) {
+        return;
+    }
+    if ((entries = malloc(n * sizeof(wc_entry_t))) == NULL) {
+        perror("malloc");
+        return;
+    }
     for (wc = *wclist; wc != NULL; wc = wc->next) {
-        fprintf(outfile, "%8d\t%s\n", wc->count, wc->word);
+        entries[i++] = (wc_entry_t) {wc->count, wc->word};
     }
+    wc_write_entries(outfile, entries, n);
+    free(entries);
 }
 
 void wordcount_insert_ordered(word_count_list_t *wclist, word_count_t *elem,
@@ -34,28 +34,62 @@
 /*
  * Representation of a word count object and word count list object.
  * PINTOS_LIST and/or PTHREADS are #define'd prior to #include to select the
- * representations.
+ * representations. ART_TRIE selects an adaptive radix tree instead.
  */
 
-#ifdef PINTOS_LIST
+#if defined(ART_TRIE)
+
+typedef struct word_count {
+    char *word;
+    int count;
+} word_count_t;
+
+/*
+ * Words are kept in an adaptive radix tree, so in-order traversal is already
+ * alphabetical. ORDER holds the result of sorting by any other comparator and
+ * is dropped when a new word is inserted.
+ */
+typedef struct word_count_list {
+    void *root;
+    size_t size;
+    word_count_t **order;
+} word_count_list_t;
+
+#elif defined(PINTOS_LIST)
 #include "list.h"
+#ifdef PTHREADS
+#include "hash.h"
+#endif
 typedef struct word_count {
     char *word;
     int count;
     struct list_elem elem;
+#ifdef PTHREADS
+    struct hash_elem helem;
+#endif
 } word_count_t;
 
 #ifdef PTHREADS
 #include <pthread.h>
+
+#include "wc_arena.h"
+/*
+ * The list keeps insertion (or sorted) order; the hash indexes it by word.
+ * With an ARENA, entries and their words are carved from it instead of the
+ * heap and the hash buckets are advised to use huge pages.
+ */
 typedef struct word_count_list {
     struct list lst;
+    struct hash index;
     pthread_mutex_t lock;
+    wc_arena_t *arena;
+    size_t advised_buckets;
 } word_count_list_t;
 #else /* PTHREADS */
 typedef struct list word_count_list_t;
 #endif /* PTHREADS */
 
-#else /* PINTOS_LIST */
+#else /* ART_TRIE, PINTOS_LIST */
 
 typedef struct word_count {
     char *word;
@@ -64,7 +98,7 @@ typedef struct word_count {
 } word_count_t;
 
 typedef word_count_t *word_count_list_t;
-#endif /* PINTOS_LIST */
+#endif /* ART_TRIE, PINTOS_LIST */
 
 /* Initialize a word count list. */
 void init_words(word_count_list_t *wclist);
@@ -95,4 +129,43 @@ void fprint_words(word_count_list_t *wclist, FILE *outfile);
 void wordcount_sort(word_count_list_t *wclist,
                     bool less(const word_count_t *, const word_count_t *));
 
+#ifdef PTHREADS
+/*
+ * The functions below move entries between tables without copying them, so
+ * that per-thread tables can be merged in parallel. None of them lock; the
+ * caller must own every table involved.
+ */
+
+/*
+ * Allocates WCLIST's entries from ARENA from now on. Tables that trade entries
+ * must either all use arenas or all use the heap, since arena entries are
+ * never freed one by one.
+ */
+void words_use_arena(word_count_list_t *wclist, wc_arena_t *arena);
+
+/* Moves every entry of WCLIST to PARTS[hash(word) % NPARTS]. */
+void partition_words(word_count_list_t *wclist, struct list parts[],
+                     size_t nparts);
+
+/* Moves every entry of SRC into WCLIST, adding counts of shared words. */
+void absorb_words(word_count_list_t *wclist, struct list *src);
+
+/*
+ * Moves the entries of PARTS[0..NPARTS), each sorted by LESS and with no word
+ * in more than one of them, into WCLIST in LESS order.
+ */
+void merge_sorted_words(word_count_list_t *wclist, word_count_list_t parts[],
+                        size_t nparts,
+                        bool less(const word_count_t *, const word_count_t *));
+#endif /* PTHREADS */
+
+#ifdef ART_TRIE
+/* Calls FN on every word starting with PREFIX, in alphabetical order. */
+void prefix_words(word_count_list_t *wclist, const char *prefix,
+                  void fn(word_count_t *, void *), void *aux);
+
+/* Adds every count in SRC to DST with one in-order walk of SRC. */
+void merge_words(word_count_list_t *dst, word_count_list_t *src);
+#endif /* ART_TRIE */
+
 #endif /* WORD_COUNT_H */
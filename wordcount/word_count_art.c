@@ -0,0 +1,552 @@
+/*
+ * Implementation of the word_count interface using an adaptive radix tree.
+ *
+ * Inner nodes come in four sizes (4, 16, 48 and 256 children) and grow as
+ * children are added. Each key is a word including its terminating NUL, so
+ * no key is a prefix of another and an in-order walk visits words in strcmp
+ * order. Leaves are word_count_t pointers tagged with the low bit.
+ *
+ * Compressed paths are stored as a pointer into the word of some leaf below
+ * the node, which every word in that subtree shares. Words are never freed
+ * while they are in the tree, so the pointer stays valid and paths of any
+ * length cost no extra memory.
+ */
+
+#ifndef ART_TRIE
+#error "ART_TRIE must be #define'd when compiling word_count_art.c"
+#endif
+
+#include <stdint.h>
+
+#include "wc_writer.h"
+#include "word_count.h"
+#include "word_helpers.h"
+
+enum { NODE4, NODE16, NODE48, NODE256 };
+
+typedef struct art_node {
+    uint8_t type;
+    uint16_t num_children;
+    uint32_t prefix_len;
+    const char *prefix;
+} art_node_t;
+
+typedef struct art_node4 {
+    art_node_t n;
+    unsigned char keys[4];
+    void *children[4];
+} art_node4_t;
+
+typedef struct art_node16 {
+    art_node_t n;
+    unsigned char keys[16];
+    void *children[16];
+} art_node16_t;
+
+typedef struct art_node48 {
+    art_node_t n;
+    unsigned char index[256]; /* Child slot + 1, or 0 if absent. */
+    void *children[48];
+} art_node48_t;
+
+typedef struct art_node256 {
+    art_node_t n;
+    void *children[256];
+} art_node256_t;
+
+#define IS_LEAF(p) (((uintptr_t) (p)) & 1)
+#define LEAF(p) ((word_count_t *) ((uintptr_t) (p) & ~(uintptr_t) 1))
+#define MAKE_LEAF(wc) ((void *) ((uintptr_t) (wc) | 1))
+
+static art_node_t *alloc_node(uint8_t type) {
+    static const size_t sizes[] = {sizeof(art_node4_t), sizeof(art_node16_t),
+                                   sizeof(art_node48_t), sizeof(art_node256_t)};
+    art_node_t *n = calloc(1, sizes[type]);
+    if (n != NULL) {
+        n->type = type;
+    }
+    return n;
+}
+
+static void copy_header(art_node_t *dst, const art_node_t *src) {
+    dst->num_children = src->num_children;
+    dst->prefix_len = src->prefix_len;
+    dst->prefix = src->prefix;
+}
+
+/* Returns the slot holding the child for byte C, or NULL. */
+static void **find_child(art_node_t *n, unsigned char c) {
+    switch (n->type) {
+    case NODE4: {
+        art_node4_t *n4 = (art_node4_t *) n;
+        for (int i = 0; i < n->num_children; i++) {
+            if (n4->keys[i] == c) {
+                return &n4->children[i];
+            }
+        }
+        return NULL;
+    }
+    case NODE16: {
+        art_node16_t *n16 = (art_node16_t *) n;
+        for (int i = 0; i < n->num_children; i++) {
+            if (n16->keys[i] == c) {
+                return &n16->children[i];
+            }
+        }
+        return NULL;
+    }
+    case NODE48: {
+        art_node48_t *n48 = (art_node48_t *) n;
+        return n48->index[c] ? &n48->children[n48->index[c] - 1] : NULL;
+    }
+    default: {
+        art_node256_t *n256 = (art_node256_t *) n;
+        return n256->children[c] ? &n256->children[c] : NULL;
+    }
+    }
+}
+
+/* Inserts CHILD under byte C into a sorted key array of a NODE4/16. */
+static void insert_sorted(unsigned char *keys, void **children, int count,
+                          unsigned char c, void *child) {
+    int i = count;
+    while (i > 0 && keys[i - 1] > c) {
+        keys[i] = keys[i - 1];
+        children[i] = children[i - 1];
+        i--;
+    }
+    keys[i] = c;
+    children[i] = child;
+}
+
+/*
+ * Adds CHILD under byte C to the node at *REF, replacing the node with the
+ * next larger type when it is full. Returns false on allocation failure.
+ */
+static bool add_child(art_node_t **ref, unsigned char c, void *child) {
+    art_node_t *n = *ref, *bigger;
+
+    switch (n->type) {
+    case NODE4: {
+        art_node4_t *n4 = (art_node4_t *) n;
+        if (n->num_children < 4) {
+            insert_sorted(n4->keys, n4->children, n->num_children++, c, child);
+            return true;
+        }
+        if ((bigger = alloc_node(NODE16)) == NULL) {
+            return false;
+        }
+        art_node16_t *n16 = (art_node16_t *) bigger;
+        copy_header(bigger, n);
+        memcpy(n16->keys, n4->keys, 4);
+        memcpy(n16->children, n4->children, 4 * sizeof(void *));
+        break;
+    }
+    case NODE16: {
+        art_node16_t *n16 = (art_node16_t *) n;
+        if (n->num_children < 16) {
+            insert_sorted(n16->keys, n16->children, n->num_children++, c,
+                          child);
+            return true;
+        }
+        if ((bigger = alloc_node(NODE48)) == NULL) {
+            return false;
+        }
+        art_node48_t *n48 = (art_node48_t *) bigger;
+        copy_header(bigger, n);
+        for (int i = 0; i < 16; i++) {
+            n48->children[i] = n16->children[i];
+            n48->index[n16->keys[i]] = i + 1;
+        }
+        break;
+    }
+    case NODE48: {
+        art_node48_t *n48 = (art_node48_t *) n;
+        if (n->num_children < 48) {
+            int slot = 0;
+            while (n48->children[slot] != NULL) {
+                slot++;
+            }
+            n48->children[slot] = child;
+            n48->index[c] = slot + 1;
+            n->num_children++;
+            return true;
+        }
+        if ((bigger = alloc_node(NODE256)) == NULL) {
+            return false;
+        }
+        art_node256_t *n256 = (art_node256_t *) bigger;
+        copy_header(bigger, n);
+        for (int b = 0; b < 256; b++) {
+            if (n48->index[b]) {
+                n256->children[b] = n48->children[n48->index[b] - 1];
+            }
+        }
+        break;
+    }
+    default: {
+        art_node256_t *n256 = (art_node256_t *) n;
+        n256->children[c] = child;
+        n->num_children++;
+        return true;
+    }
+    }
+
+    free(n);
+    *ref = bigger;
+    return add_child(ref, c, child);
+}
+
+static word_count_t *new_leaf(char *word, int count) {
+    word_count_t *wc = malloc(sizeof(word_count_t));
+    if (wc == NULL) {
+        perror("malloc");
+        return NULL;
+    }
+    wc->word = word;
+    wc->count = count;
+    return wc;
+}
+
+/*
+ * Finds WORD below *REF, inserting it with count 0 if absent. *CREATED is set
+ * when WORD was inserted, in which case the tree owns WORD.
+ */
+static word_count_t *art_upsert(void **ref, char *word, bool *created) {
+    const unsigned char *key = (const unsigned char *) word;
+    size_t depth = 0;
+
+    *created = false;
+    for (;;) {
+        void *p = *ref;
+        art_node_t *n;
+
+        if (p == NULL) {
+            word_count_t *wc = new_leaf(word, 0);
+            if (wc != NULL) {
+                *ref = MAKE_LEAF(wc);
+                *created = true;
+            }
+            return wc;
+        }
+
+        if (IS_LEAF(p)) {
+            word_count_t *old = LEAF(p), *wc;
+            const unsigned char *okey = (const unsigned char *) old->word;
+            size_t i = depth;
+
+            /* Every byte above DEPTH has matched, possibly including NUL. */
+            if (depth > 0 && key[depth - 1] == '\0') {
+                return old;
+            }
+            while (okey[i] == key[i] && key[i] != '\0') {
+                i++;
+            }
+            if (okey[i] == key[i]) {
+                return old;
+            }
+            if ((n = alloc_node(NODE4)) == NULL) {
+                perror("calloc");
+                return NULL;
+            }
+            if ((wc = new_leaf(word, 0)) == NULL) {
+                free(n);
+                return NULL;
+            }
+            n->prefix = old->word + depth;
+            n->prefix_len = i - depth;
+            add_child(&n, okey[i], p);
+            add_child(&n, key[i], MAKE_LEAF(wc));
+            *ref = n;
+            *created = true;
+            return wc;
+        }
+
+        n = p;
+        if (n->prefix_len > 0) {
+            const unsigned char *prefix = (const unsigned char *) n->prefix;
+            uint32_t i = 0;
+
+            while (i < n->prefix_len && prefix[i] == key[depth + i]) {
+                i++;
+            }
+            if (i < n->prefix_len) {
+                /* Split the compressed path at the first mismatch. */
+                art_node_t *parent = alloc_node(NODE4);
+                word_count_t *wc;
+
+                if (parent == NULL) {
+                    perror("calloc");
+                    return NULL;
+                }
+                if ((wc = new_leaf(word, 0)) == NULL) {
+                    free(parent);
+                    return NULL;
+                }
+                parent->prefix = n->prefix;
+                parent->prefix_len = i;
+                add_child(&parent, prefix[i], n);
+                add_child(&parent, key[depth + i], MAKE_LEAF(wc));
+                n->prefix += i + 1;
+                n->prefix_len -= i + 1;
+                *ref = parent;
+                *created = true;
+                return wc;
+            }
+            depth += n->prefix_len;
+        }
+
+        void **child = find_child(n, key[depth]);
+        if (child == NULL) {
+            word_count_t *wc = new_leaf(word, 0);
+            if (wc == NULL) {
+                return NULL;
+            }
+            if (!add_child((art_node_t **) ref, key[depth], MAKE_LEAF(wc))) {
+                perror("calloc");
+                free(wc);
+                return NULL;
+            }
+            *created = true;
+            return wc;
+        }
+        ref = child;
+        depth++;
+    }
+}
+
+/* Calls FN on every leaf below P in key order. */
+static void art_walk(void *p, void fn(word_count_t *, void *), void *aux) {
+    art_node_t *n = p;
+
+    if (p == NULL) {
+        return;
+    }
+    if (IS_LEAF(p)) {
+        fn(LEAF(p), aux);
+        return;
+    }
+    switch (n->type) {
+    case NODE4:
+        for (int i = 0; i < n->num_children; i++) {
+            art_walk(((art_node4_t *) n)->children[i], fn, aux);
+        }
+        break;
+    case NODE16:
+        for (int i = 0; i < n->num_children; i++) {
+            art_walk(((art_node16_t *) n)->children[i], fn, aux);
+        }
+        break;
+    case NODE48: {
+        art_node48_t *n48 = (art_node48_t *) n;
+        for (int b = 0; b < 256; b++) {
+            if (n48->index[b]) {
+                art_walk(n48->children[n48->index[b] - 1], fn, aux);
+            }
+        }
+        break;
+    }
+    default:
+        for (int b = 0; b < 256; b++) {
+            art_walk(((art_node256_t *) n)->children[b], fn, aux);
+        }
+        break;
+    }
+}
+
+void init_words(word_count_list_t *wclist) {
+    wclist->root = NULL;
+    wclist->size = 0;
+    wclist->order = NULL;
+}
+
+size_t len_words(word_count_list_t *wclist) {
+    return wclist->size;
+}
+
+word_count_t *find_word(word_count_list_t *wclist, char *word) {
+    const unsigned char *key = (const unsigned char *) word;
+    void *p = wclist->root;
+    size_t depth = 0;
+
+    while (p != NULL && !IS_LEAF(p)) {
+        art_node_t *n = p;
+        void **child;
+
+        /* Compressed paths never contain NUL, so this stops at KEY's end. */
+        for (uint32_t i = 0; i < n->prefix_len; i++) {
+            if ((unsigned char) n->prefix[i] != key[depth + i]) {
+                return NULL;
+            }
+        }
+        depth += n->prefix_len;
+        if ((child = find_child(n, key[depth])) == NULL) {
+            return NULL;
+        }
+        p = *child;
+        depth++;
+    }
+    if (p != NULL && strcmp(LEAF(p)->word, word) == 0) {
+        return LEAF(p);
+    }
+    return NULL;
+}
+
+word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
+                                  int count) {
+    bool created;
+    word_count_t *wc = art_upsert(&wclist->root, word, &created);
+
+    if (wc == NULL) {
+        return NULL;
+    }
+    if (created) {
+        wclist->size++;
+        free(wclist->order);
+        wclist->order = NULL;
+    } else {
+        free(word);
+    }
+    wc->count += count;
+    return wc;
+}
+
+word_count_t *add_word(word_count_list_t *wclist, char *word) {
+    return add_word_with_count(wclist, word, 1);
+}
+
+typedef struct collect {
+    wc_entry_t *entries;
+    word_count_t **words;
+    size_t n;
+} collect_t;
+
+static void collect_entry(word_count_t *wc, void *aux) {
+    collect_t *c = aux;
+    if (c->entries != NULL) {
+        c->entries[c->n] = (wc_entry_t) {wc->count, wc->word};
+    } else {
+        c->words[c->n] = wc;
+    }
+    c->n++;
+}
+
+void fprint_words(word_count_list_t *wclist, FILE *outfile) {
+    collect_t c = {0};
+
+    if (wclist->size == 0) {
+        return;
+    }
+    if ((c.entries = malloc(wclist->size * sizeof(wc_entry_t))) == NULL) {
+        perror("malloc");
+        return;
+    }
+    if (wclist->order != NULL) {
+        for (; c.n < wclist->size; c.n++) {
+            word_count_t *wc = wclist->order[c.n];
+            c.entries[c.n] = (wc_entry_t) {wc->count, wc->word};
+        }
+    } else {
+        art_walk(wclist->root, collect_entry, &c);
+    }
+    wc_write_entries(outfile, c.entries, c.n);
+    free(c.entries);
+}
+
+/* Stable merge sort of A[0..N) using TMP as scratch space. */
+static void merge_sort(word_count_t **a, word_count_t **tmp, size_t n,
+                       bool less(const word_count_t *, const word_count_t *)) {
+    size_t mid = n / 2, i = 0, j = mid, k = 0;
+
+    if (n < 2) {
+        return;
+    }
+    merge_sort(a, tmp, mid, less);
+    merge_sort(a + mid, tmp, n - mid, less);
+    while (i < mid && j < n) {
+        tmp[k++] = less(a[j], a[i]) ? a[j++] : a[i++];
+    }
+    while (i < mid) {
+        tmp[k++] = a[i++];
+    }
+    while (j < n) {
+        tmp[k++] = a[j++];
+    }
+    memcpy(a, tmp, n * sizeof(word_count_t *));
+}
+
+void wordcount_sort(word_count_list_t *wclist,
+                    bool less(const word_count_t *, const word_count_t *)) {
+    collect_t c = {0};
+    word_count_t **tmp;
+
+    free(wclist->order);
+    wclist->order = NULL;
+    if (less == less_word || wclist->size == 0) {
+        /* The tree is already in alphabetical order. */
+        return;
+    }
+    c.words = malloc(wclist->size * sizeof(word_count_t *));
+    tmp = malloc(wclist->size * sizeof(word_count_t *));
+    if (c.words == NULL || tmp == NULL) {
+        perror("malloc");
+        free(c.words);
+        free(tmp);
+        return;
+    }
+    art_walk(wclist->root, collect_entry, &c);
+    merge_sort(c.words, tmp, c.n, less);
+    free(tmp);
+    wclist->order = c.words;
+}
+
+void prefix_words(word_count_list_t *wclist, const char *prefix,
+                  void fn(word_count_t *, void *), void *aux) {
+    const unsigned char *key = (const unsigned char *) prefix;
+    size_t len = strlen(prefix), depth = 0;
+    void *p = wclist->root;
+
+    while (p != NULL && !IS_LEAF(p) && depth < len) {
+        art_node_t *n = p;
+        void **child;
+        size_t cmp = n->prefix_len;
+
+        if (cmp > len - depth) {
+            cmp = len - depth;
+        }
+        if (memcmp(n->prefix, key + depth, cmp) != 0) {
+            return;
+        }
+        depth += n->prefix_len;
+        if (depth >= len) {
+            break;
+        }
+        if ((child = find_child(n, key[depth])) == NULL) {
+            return;
+        }
+        p = *child;
+        depth++;
+    }
+    if (p != NULL && IS_LEAF(p) && strncmp(LEAF(p)->word, prefix, len) != 0) {
+        return;
+    }
+    art_walk(p, fn, aux);
+}
+
+static void merge_entry(word_count_t *wc, void *aux) {
+    word_count_list_t *dst = aux;
+    word_count_t *found = find_word(dst, wc->word);
+    char *word;
+
+    if (found != NULL) {
+        found->count += wc->count;
+    } else if ((word = strdup(wc->word)) == NULL) {
+        perror("strdup");
+    } else {
+        add_word_with_count(dst, word, wc->count);
+    }
+}
+
+void merge_words(word_count_list_t *dst, word_count_list_t *src) {
+    art_walk(src->root, merge_entry, dst);
+}
@@ -24,6 +24,7 @@
 #error "PINTOS_LIST must be #define'd when compiling word_count_l.c"
 #endif
 
+#include "wc_writer.h"
 #include "word_count.h"
 
 void init_words(word_count_list_t *wclist) {
@@ -66,6 +67,7 @@ word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
     word_count_t *wc = find_word(wclist, word);
     if (wc != NULL) {
         wc->count += count;
+        free(word); //we own word, and the list already has a copy
         return wc;
     }
 
@@ -90,12 +92,24 @@ word_count_t *add_word(word_count_list_t *wclist, char *word) {
 void fprint_words(word_count_list_t *wclist, FILE *outfile) {
     //iterate through wclist
     //extract struct pointer from list element --> like in find_word
-    //fprintf to outfile like in word_count.c
+    //hand the (count, word) pairs to the bulk writer in list order
 
+    size_t n = len_words(wclist), i = 0;
+    wc_entry_t *entries;
+
+    if (n == 0) {
+        return;
+    }
+    if ((entries = malloc(n * sizeof(wc_entry_t))) == NULL) {
+        perror("malloc");
+        return;
+    }
     for (struct list_elem *current = list_begin(wclist); current != list_end(wclist); current = list_next(current)) {
         word_count_t *curStruct = list_entry(current, word_count_t, elem);
-        fprintf(outfile, "%8d\t%s\n", curStruct->count, curStruct->word);
+        entries[i++] = (wc_entry_t) {curStruct->count, curStruct->word};
     }
+    wc_write_entries(outfile, entries, n);
+    free(entries);
 }
 
 static bool less_list(const struct list_elem *ewc1,
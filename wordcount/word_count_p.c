@@ -28,13 +28,79 @@
 #error "PTHREADS must be #define'd when compiling word_count_lp.c"
 #endif
 
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "wc_stats.h"
+#include "wc_writer.h"
 #include "word_count.h"
 
+static unsigned word_hash(const struct hash_elem *e, void *aux) {
+    return hash_string(hash_entry(e, word_count_t, helem)->word);
+}
+
+static bool word_hash_less(const struct hash_elem *a,
+                           const struct hash_elem *b, void *aux) {
+    return strcmp(hash_entry(a, word_count_t, helem)->word,
+                  hash_entry(b, word_count_t, helem)->word) < 0;
+}
+
 void init_words(word_count_list_t *wclist) {
     //there's a separate struct in word_count.h for pthreaad
     list_init(&wclist->lst);
+    //index by word so lookups don't walk the whole list
+    if (!hash_init(&wclist->index, word_hash, word_hash_less, NULL)) {
+        perror("hash_init");
+        exit(1);
+    }
     //this is from pthread.h import
     pthread_mutex_init(&wclist->lock, NULL);
+    wclist->arena = NULL;
+    wclist->advised_buckets = 0;
+}
+
+void words_use_arena(word_count_list_t *wclist, wc_arena_t *arena) {
+    wclist->arena = arena;
+}
+
+//the bucket array comes from malloc inside hash.c, so the best we can do is
+//ask for huge pages on the whole pages it covers each time it gets rehashed
+static void advise_buckets(word_count_list_t *wclist) {
+    struct hash *h = &wclist->index;
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start, end;
+
+    if (wclist->arena == NULL || wclist->arena->pages == WC_PAGES_SMALL ||
+        h->bucket_cnt == wclist->advised_buckets) {
+        return;
+    }
+    wclist->advised_buckets = h->bucket_cnt;
+    start = ((uintptr_t) h->buckets + page - 1) & ~(page - 1);
+    end = ((uintptr_t) (h->buckets + h->bucket_cnt)) & ~(page - 1);
+    if (end > start) {
+        madvise((void *) start, end - start, MADV_HUGEPAGE);
+    }
+}
+
+//heap or arena, depending on the list
+static word_count_t *new_entry(word_count_list_t *wclist, char *word) {
+    word_count_t *wc;
+    if (wclist->arena == NULL) {
+        if ((wc = malloc(sizeof(word_count_t))) == NULL) {
+            perror("malloc");
+            return NULL;
+        }
+        wc->word = word; //add_word takes ownership, no copy needed
+        return wc;
+    }
+    //one copy per distinct word, packed next to its entry
+    wc = wc_arena_alloc(wclist->arena, sizeof(word_count_t));
+    if (wc == NULL || (wc->word = wc_arena_strdup(wclist->arena, word)) == NULL) {
+        return NULL;
+    }
+    free(word);
+    return wc;
 }
 
 size_t len_words(word_count_list_t *wclist) {
@@ -43,60 +109,77 @@ size_t len_words(word_count_list_t *wclist) {
 
 word_count_t *find_word(word_count_list_t *wclist, char *word) {
     //no mods = we can jsut read = no locks
-    struct list_elem *current;
-    for (current = list_begin(&wclist->lst); current != list_end(&wclist->lst); current = list_next(current)) {
-        word_count_t *curStruct = list_entry(current, word_count_t, elem);
-        if (strcmp(curStruct->word, word) == 0) {
-            return curStruct;
-        }
-    }
-    return NULL;
+    word_count_t key;
+    struct hash_elem *found;
+
+    key.word = word;
+    found = hash_find(&wclist->index, &key.helem);
+    return (found != NULL) ? hash_entry(found, word_count_t, helem) : NULL;
 }
 
-word_count_t *add_word(word_count_list_t *wclist, char *word) {
+word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
+                                  int count) {
     //lock the list during search/insert
     //lock the word when adding to its count.
     //otherwise its like _l.c
     word_count_t *wc;
 
+    WC_STATS_NOW(wait_start);
     pthread_mutex_lock(&wclist->lock);
+    WC_STATS_NOW(hold_start);
+    WC_STATS_ADD(lock_wait_ns, hold_start - wait_start);
     wc = find_word(wclist, word);
     if (wc != NULL) {
         // pthread_mutex_lock(&wc->lock);
-        wc->count++;
+        wc->count += count;
         // pthread_mutex_unlock(&wc->lock);
+        WC_STATS_RELEASE(hold_start);
         pthread_mutex_unlock(&wclist->lock);
+        free(word); //we own word, and the table already has a copy
         return wc;
     }
 
-    wc = malloc(sizeof(word_count_t));
-    // if (!wc) { //maybe dont need this ; ask office hours
-    //     pthread_mutex_unlock(&wclist->list_lock);
-    //     return NULL;
-    // }
-    wc->word = strdup(word); //a copy of word
-    // if (!wc->word) { 
-    //     free(wc);
-    //     pthread_mutex_unlock(&wclist->list_lock);
-    //     return NULL;
-    // }
-    wc->count = 1;
+    wc = new_entry(wclist, word);
+    if (wc == NULL) {
+        WC_STATS_RELEASE(hold_start);
+        pthread_mutex_unlock(&wclist->lock);
+        return NULL;
+    }
+    wc->count = count;
     // pthread_mutex_init(&wc->lock, NULL);
     list_push_back(&wclist->lst, &wc->elem);
+    hash_insert(&wclist->index, &wc->helem);
+    advise_buckets(wclist);
+    WC_STATS_ADD(allocs, 1);
+    WC_STATS_RELEASE(hold_start);
     pthread_mutex_unlock(&wclist->lock);
     return wc;
 }
 
+word_count_t *add_word(word_count_list_t *wclist, char *word) {
+    return add_word_with_count(wclist, word, 1);
+}
+
 void fprint_words(word_count_list_t *wclist, FILE *outfile) {
-    //need to lock each word’s mutex when printing
-    //bc can't read while another thread writes
+    //called once all workers are joined, so nothing writes while we read
+    //hand the (count, word) pairs to the bulk writer in list order
     struct list_elem *current;
+    size_t n = len_words(wclist), i = 0;
+    wc_entry_t *entries;
+
+    if (n == 0) {
+        return;
+    }
+    if ((entries = malloc(n * sizeof(wc_entry_t))) == NULL) {
+        perror("malloc");
+        return;
+    }
     for (current = list_begin(&wclist->lst); current != list_end(&wclist->lst); current = list_next(current)) {
         word_count_t *curStruct = list_entry(current, word_count_t, elem);
-        // pthread_mutex_lock(&curStruct->lock);
-        fprintf(outfile, "%8d\t%s\n", curStruct->count, curStruct->word);
-        // pthread_mutex_unlock(&curStruct->lock);
+        entries[i++] = (wc_entry_t) {curStruct->count, curStruct->word};
     }
+    wc_write_entries(outfile, entries, n);
+    free(entries);
 }
 
 //added this (it's like the one from word_count_l.c)
@@ -114,4 +197,63 @@ void wordcount_sort(word_count_list_t *wclist,
     list_sort(&wclist->lst, (list_less_func *) less_list, less);
 }
 
+void partition_words(word_count_list_t *wclist, struct list parts[],
+                     size_t nparts) {
+    //pop every entry off the list and push it onto the part its hash picks
+    while (!list_empty(&wclist->lst)) {
+        struct list_elem *e = list_pop_front(&wclist->lst);
+        word_count_t *wc = list_entry(e, word_count_t, elem);
+        list_push_back(&parts[hash_string(wc->word) % nparts], e);
+    }
+    hash_clear(&wclist->index, NULL);
+}
+
+void absorb_words(word_count_list_t *wclist, struct list *src) {
+    //hash_insert hands back the entry already there, if any
+    while (!list_empty(src)) {
+        struct list_elem *e = list_pop_front(src);
+        word_count_t *wc = list_entry(e, word_count_t, elem);
+        struct hash_elem *old = hash_insert(&wclist->index, &wc->helem);
+        if (old != NULL) {
+            hash_entry(old, word_count_t, helem)->count += wc->count;
+            if (wclist->arena == NULL) { //arena entries go when the arena does
+                free(wc->word);
+                free(wc);
+            }
+        } else {
+            list_push_back(&wclist->lst, e);
+            advise_buckets(wclist);
+        }
+    }
+}
 
+void merge_sorted_words(word_count_list_t *wclist, word_count_list_t parts[],
+                        size_t nparts,
+                        bool less(const word_count_t *, const word_count_t *)) {
+    //the parts' indexes only need resetting; their entries move to wclist
+    for (size_t i = 0; i < nparts; i++) {
+        hash_clear(&parts[i].index, NULL);
+    }
+    //k-way merge: repeatedly move the smallest head among the parts
+    for (;;) {
+        word_count_t *min = NULL;
+        size_t min_part = 0;
+        for (size_t i = 0; i < nparts; i++) {
+            if (!list_empty(&parts[i].lst)) {
+                word_count_t *head = list_entry(list_front(&parts[i].lst),
+                                                word_count_t, elem);
+                if (min == NULL || less(head, min)) {
+                    min = head;
+                    min_part = i;
+                }
+            }
+        }
+        if (min == NULL) {
+            break;
+        }
+        list_pop_front(&parts[min_part].lst);
+        list_push_back(&wclist->lst, &min->elem);
+        hash_insert(&wclist->index, &min->helem);
+        advise_buckets(wclist);
+    }
+}
@@ -27,6 +27,8 @@
 #include <ctype.h>
 #include <stdio.h>
 
+#include "readahead.h"
+#include "wc_stats.h"
 #include "word_count.h"
 
 /*
@@ -34,14 +36,14 @@
  * stores it in a malloc'd buffer. Returns length of the word, or 0 if reached
  * end of file.
  */
-static size_t get_word(char **word, FILE *infile) {
+static size_t get_word(char **word, readahead_t *infile) {
     int ch;
     size_t buffer_cap = 16;
     size_t index = 0;
     char *buffer;
 
     /* Skip initial non-alpha characters. */
-    while (!isalpha(ch = fgetc(infile))) {
+    while (!isalpha(ch = readahead_getc(infile))) {
         if (ch == EOF) {
             return 0;
         }
@@ -52,6 +54,7 @@ static size_t get_word(char **word, FILE *infile) {
         perror("malloc");
         return 0;
     }
+    WC_STATS_ADD(allocs, 1);
 
     /* Accumulate word's characters into buffer. */
     do {
@@ -67,28 +70,69 @@ static size_t get_word(char **word, FILE *infile) {
                 return 0;
             }
             buffer = new_buffer;
+            WC_STATS_ADD(allocs, 1);
         }
-    } while (isalpha(ch = fgetc(infile)));
+    } while (isalpha(ch = readahead_getc(infile)));
     buffer[index] = '\0';
 
     *word = buffer;
     return index;
 }
 
-void count_words(word_count_list_t *wclist, FILE *infile) {
-    /* Extract all words in infile and update word counts for them. */
+static void walk_words(readahead_t *ra, bool fn(char *word, void *aux),
+                       void *aux) {
     char *word;
     size_t len;
-    while ((len = get_word(&word, infile)) != 0) {
+
+    for (;;) {
+        WC_STATS_NOW(start);
+        len = get_word(&word, ra);
+        WC_STATS_SINCE(tokenize_ns, start);
+        if (len == 0) {
+            break;
+        }
+        WC_STATS_ADD(words, 1);
         if (len == 1) {
             free(word);
-        } else if (add_word(wclist, word) == NULL) {
+        } else if (!fn(word, aux)) {
             free(word);
-            return;
+            break;
         }
     }
 }
 
+void for_each_word(FILE *infile, bool fn(char *word, void *aux), void *aux) {
+    readahead_t *ra;
+
+    if ((ra = readahead_open(infile)) == NULL) {
+        return;
+    }
+    walk_words(ra, fn, aux);
+    readahead_close(ra);
+}
+
+void for_each_word_in(const char *buf, size_t len,
+                      bool fn(char *word, void *aux), void *aux) {
+    readahead_t ra;
+
+    readahead_init_buffer(&ra, buf, len);
+    WC_STATS_ADD(bytes_read, len);
+    walk_words(&ra, fn, aux);
+}
+
+static bool add_to_list(char *word, void *wclist) {
+    return add_word(wclist, word) != NULL;
+}
+
+void count_words(word_count_list_t *wclist, FILE *infile) {
+    /* Extract all words in infile and update word counts for them. */
+    for_each_word(infile, add_to_list, wclist);
+}
+
+void count_words_in(word_count_list_t *wclist, const char *buf, size_t len) {
+    for_each_word_in(buf, len, add_to_list, wclist);
+}
+
 bool less_count(const word_count_t *wc1, const word_count_t *wc2) {
     return (wc1->count < wc2->count) ||
            ((wc1->count == wc2->count) && (strcmp(wc1->word, wc2->word) < 0));
@@ -36,6 +36,20 @@
  */
 void count_words(word_count_list_t *wclist, FILE *infile);
 
+/* Like count_words, but reads the LEN bytes at BUF. */
+void count_words_in(word_count_list_t *wclist, const char *buf, size_t len);
+
+/*
+ * Reads all words from a stream, skipping one-letter words as count_words
+ * does, and passes each malloc'd word to FN, which takes ownership of it.
+ * Stops early if FN returns false.
+ */
+void for_each_word(FILE *infile, bool fn(char *word, void *aux), void *aux);
+
+/* Like for_each_word, but reads the LEN bytes at BUF. */
+void for_each_word_in(const char *buf, size_t len,
+                      bool fn(char *word, void *aux), void *aux);
+
 /*
  * Returns true if the first entry has a lower count than the second entry,
  * breaking ties according to alphabetical order.
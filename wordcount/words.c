@@ -29,17 +29,70 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "ngram.h"
 #include "word_count.h"
 #include "word_helpers.h"
 
+/*
+ * Counts N-grams across the files in ARGV (or stdin) and prints them. Each file
+ * is its own stream, so no n-gram spans two files.
+ */
+static int count_ngram_files(int argc, char *argv[], int n, bool alphabetical) {
+    ngram_table_t table;
+    if (!ngram_init(&table, n)) {
+        return 1;
+    }
+    if (argc <= 1) {
+        count_ngrams(&table, stdin);
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *infile = fopen(argv[i], "r");
+        if (infile == NULL) {
+            perror("fopen");
+            return 1;
+        }
+        count_ngrams(&table, infile);
+        fclose(infile);
+    }
+    ngram_print(&table, stdout, alphabetical);
+    ngram_destroy(&table);
+    return 0;
+}
+
 /*
  * main - handle command line and file handles.
+ *
+ * With -a, words are printed in alphabetical order instead of by count.
+ * With -n N, runs of N consecutive words are counted instead of single words.
  */
 int main(int argc, char *argv[]) {
     /* Create the empty data structure. */
     word_count_list_t word_counts;
     init_words(&word_counts);
 
+    bool (*less)(const word_count_t *, const word_count_t *) = less_count;
+    int n = 0;
+    while (argc > 1) {
+        if (strcmp(argv[1], "-a") == 0) {
+            less = less_word;
+        } else if (strcmp(argv[1], "-n") == 0 && argc > 2) {
+            if ((n = ngram_parse_n(argv[2])) == 0) {
+                fprintf(stderr, "-n: expected 1..%d\n", NGRAM_MAX);
+                return 1;
+            }
+            argv++;
+            argc--;
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
+
+    if (n > 0) {
+        return count_ngram_files(argc, argv, n, less == less_word);
+    }
+
     if (argc <= 1) {
         count_words(&word_counts, stdin);
     } else {
@@ -57,7 +110,7 @@ int main(int argc, char *argv[]) {
     }
 
     /* Output final result. */
-    wordcount_sort(&word_counts, less_count);
+    wordcount_sort(&word_counts, less);
     fprint_words(&word_counts, stdout);
     return 0;
 }